@@ -0,0 +1,119 @@
+#include "AdaptiveFusionStrategy.h"
+
+#include <chrono>
+#include "easylogging++.h"
+
+namespace transformation_stream
+{
+namespace
+{
+	// Weight of a new sample in moving averages
+	const double AVERAGE_WEIGHT = 1.0 / 8;
+	// The fused mode is off when reads become this times slower then the switch-on level. It prevents flapping
+	const double FUSE_HYSTERESIS = 2.0;
+	// The reader waits for the engine to transform queued blocks not longer then this. Then it queues the block
+	const auto ENGINE_DRAIN_TIMEOUT = std::chrono::milliseconds(100);
+
+	double updateAverage(double average, double sample)
+	{
+		return average == 0 ? sample : average + (sample - average) * AVERAGE_WEIGHT;
+	}
+}
+
+AdaptiveFusionStrategy::AdaptiveFusionStrategy(ITransformationStrategy& strategy, size_t fusedBlockSize, double fuseRatio) :
+	m_strategy(strategy),
+	m_fusedBlockSize(fusedBlockSize),
+	m_fuseRatio(fuseRatio),
+	m_transformNsPerByte(0),
+	m_readNsPerByte(0),
+	m_isFused(false),
+	m_queuedCount(0),
+	m_engineTransformedCount(0),
+	m_inlineCount(0),
+	m_modeSwitchesCount(0)
+{
+	if (m_fusedBlockSize == 0)
+	{
+		throw std::invalid_argument("Fused block size should have a positive value.");
+	}
+}
+
+AdaptiveFusionStrategy::~AdaptiveFusionStrategy()
+{
+	LOG(INFO) << "Stage fusion: " << m_inlineCount << " blocks transformed by the reader, "
+		<< m_queuedCount << " by the engine. Mode switches " << m_modeSwitchesCount;
+}
+
+void AdaptiveFusionStrategy::transformLocked(BlockPTR data)
+{
+	const size_t dataSize = data->size();
+	const auto start = std::chrono::steady_clock::now();
+	m_strategy.transform(std::move(data));
+	const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	if (dataSize)
+	{
+		m_transformNsPerByte = updateAverage(m_transformNsPerByte, static_cast<double>(ns) / dataSize);
+	}
+}
+
+void AdaptiveFusionStrategy::transform(BlockPTR data)
+{
+	if (!data)
+		return;
+
+	{
+		std::lock_guard<decltype(m_mutex)> lock(m_mutex);
+		transformLocked(std::move(data));
+		++m_engineTransformedCount;
+	}
+	m_engineTransformedCV.notify_one();
+}
+
+void AdaptiveFusionStrategy::dump()
+{
+	std::lock_guard<decltype(m_mutex)> lock(m_mutex);
+	m_strategy.dump();
+}
+
+void AdaptiveFusionStrategy::flush()
+{
+	std::lock_guard<decltype(m_mutex)> lock(m_mutex);
+	m_strategy.flush();
+}
+
+BlockPTR AdaptiveFusionStrategy::tryTransformInline(BlockPTR data, uint64_t readNs)
+{
+	if (!data || data->empty())
+		return data;
+
+	m_readNsPerByte = updateAverage(m_readNsPerByte, static_cast<double>(readNs) / data->size());
+	const double transformNsPerByte = m_transformNsPerByte;
+	// Nothing is known about the transformation until the engine has done something
+	const bool isFused = transformNsPerByte > 0 &&
+		m_readNsPerByte < m_fuseRatio * transformNsPerByte * (m_isFused ? FUSE_HYSTERESIS : 1.0);
+	if (isFused != m_isFused)
+	{
+		m_isFused = isFused;
+		++m_modeSwitchesCount;
+		LOG(INFO) << "Stage fusion is " << (m_isFused ? "on" : "off") << ". Read " << m_readNsPerByte
+			<< " ns/B, transformation " << transformNsPerByte << " ns/B";
+	}
+
+	if (!m_isFused)
+	{
+		++m_queuedCount;
+		return data;
+	}
+	// Blocks queued before should be transformed first. The engine is draining them now
+	std::unique_lock<decltype(m_mutex)> lock(m_mutex);
+	if (!m_engineTransformedCV.wait_for(lock, ENGINE_DRAIN_TIMEOUT,
+		[this]() { return m_engineTransformedCount == m_queuedCount; }))
+	{
+		++m_queuedCount;
+		return data;
+	}
+	transformLocked(std::move(data));
+	++m_inlineCount;
+	return BlockPTR(nullptr);
+}
+};//end of the namespace transformation_stream
@@ -0,0 +1,64 @@
+#pragma once
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+#include "ITransformationStrategy.h"
+
+namespace transformation_stream
+{
+// A decorator of a strategy for the adaptive fusion of the read and the transformation stages.
+// While reads are cheap comparing to the transformation (the file is in the page cache), the reader thread
+// transforms each small block right after its read, when the data is still in the CPU cache.
+// When reads become slow, blocks go through the queue to the engine again, so IO and transformation overlap.
+// Blocks are transformed strictly in the read order: the reader transforms a block itself only if
+// all blocks queued before it are already transformed by the engine.
+class AdaptiveFusionStrategy : public ITransformationStrategy
+{
+public:
+	// strategy - the decorated strategy
+	// fusedBlockSize - a read size in the fused mode. It should fit in the L2 cache
+	// fuseRatio - the fused mode is on while read time is less then fuseRatio of the transformation time
+	AdaptiveFusionStrategy(ITransformationStrategy& strategy, size_t fusedBlockSize, double fuseRatio);
+
+	virtual ~AdaptiveFusionStrategy();
+
+	// The engine side. Calls are synchronized with inline transformations of the reader
+	void transform(BlockPTR data) override;
+
+	void dump() override;
+
+	void flush() override;
+
+	// The reader side. It should be called by one thread only.
+	// Returns true if the next read should be done by fusedBlockSize
+	bool isFused() const { return m_isFused; }
+
+	size_t getFusedBlockSize() const { return m_fusedBlockSize; }
+
+	// Takes a just read block. readNs - time of its read.
+	// Returns nullptr if the block is transformed inline. Otherwise returns the block back to be queued
+	BlockPTR tryTransformInline(BlockPTR data, uint64_t readNs);
+
+private:
+	// Transforms under the lock and updates the transformation time estimation
+	void transformLocked(BlockPTR data);
+
+	ITransformationStrategy& m_strategy;
+	const size_t m_fusedBlockSize;
+	const double m_fuseRatio;
+	std::mutex m_mutex;
+	// Events of the engine's transformations. The reader waits them to drain the queue before the fused mode
+	std::condition_variable m_engineTransformedCV;
+
+	// Moving averages of time per byte
+	std::atomic<double> m_transformNsPerByte;
+	double m_readNsPerByte; // The reader thread only
+
+	bool m_isFused; // The reader thread only
+	std::atomic<uint64_t> m_queuedCount; // Blocks passed to the queue by the reader
+	std::atomic<uint64_t> m_engineTransformedCount; // Blocks transformed by the engine
+	uint64_t m_inlineCount; // Blocks transformed by the reader. Just for logs
+	uint64_t m_modeSwitchesCount; // Just for logs
+};
+};//end of the namespace transformation_stream
@@ -0,0 +1,93 @@
+#include "AllocationCounter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+	std::atomic<uint64_t> g_allocationsCount(0);
+
+#ifdef FS_COUNT_ALLOCATIONS
+	void* countedAllocate(std::size_t size)
+	{
+		g_allocationsCount.fetch_add(1, std::memory_order_relaxed);
+		// malloc(0) could return nullptr, but new should return a unique pointer
+		return std::malloc(size ? size : 1);
+	}
+#endif
+}
+
+namespace transformation_stream
+{
+bool isAllocationsCountingEnabled()
+{
+#ifdef FS_COUNT_ALLOCATIONS
+	return true;
+#else
+	return false;
+#endif
+}
+
+uint64_t getAllocationsCount()
+{
+	return g_allocationsCount.load(std::memory_order_relaxed);
+}
+}
+
+#ifdef FS_COUNT_ALLOCATIONS
+void* operator new(std::size_t size)
+{
+	void* pointer = countedAllocate(size);
+	if (!pointer)
+	{
+		throw std::bad_alloc();
+	}
+	return pointer;
+}
+
+void* operator new[](std::size_t size)
+{
+	return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+	return countedAllocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+	return countedAllocate(size);
+}
+
+void operator delete(void* pointer) noexcept
+{
+	std::free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept
+{
+	std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept
+{
+	std::free(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t) noexcept
+{
+	std::free(pointer);
+}
+
+void operator delete(void* pointer, const std::nothrow_t&) noexcept
+{
+	std::free(pointer);
+}
+
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept
+{
+	std::free(pointer);
+}
+#endif
@@ -0,0 +1,17 @@
+#pragma once
+#include <cstdint>
+
+namespace transformation_stream
+{
+// If FS_COUNT_ALLOCATIONS is defined (-DFS_COUNT_ALLOCATIONS or /D FS_COUNT_ALLOCATIONS), global operator new
+// and delete are replaced in AllocationCounter.cpp to count heap allocations of the process.
+// The counter is a relaxed atomic, so it costs much less then the allocation itself.
+// Benchmarks use it to show allocations per block of the hot paths. It's a build for benchmarks only:
+// a production build keeps the allocator of the runtime and links nothing which replaces it.
+
+// True if the build counts allocations
+bool isAllocationsCountingEnabled();
+
+// Allocations by operator new (all threads) since the start of the process. Always 0 if they aren't counted
+uint64_t getAllocationsCount();
+}
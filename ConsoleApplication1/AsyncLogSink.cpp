@@ -0,0 +1,300 @@
+#include "AsyncLogSink.h"
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include "LogRoute.h"
+
+namespace transformation_stream
+{
+namespace
+{
+	const std::string ASYNC_CALLBACK_ID = "AsyncLogSink";
+	const std::string DEFAULT_CALLBACK_ID = "DefaultLogDispatchCallback";
+	// The writer sleeps up to this time if nobody wakes it up
+	const auto WRITER_IDLE_TIMEOUT = std::chrono::milliseconds(50);
+
+	std::atomic<uint64_t> g_lastSinkId{ 0 };
+	// The ring of the thread and the sink which owns it
+	thread_local std::shared_ptr<LogRing> t_ring;
+	thread_local uint64_t t_ringSinkId = 0;
+
+	// Moves built lines to the sink instead of writing them
+	class AsyncLogDispatchCallback : public el::LogDispatchCallback
+	{
+	public:
+		void setSink(AsyncLogSink* sink)
+		{
+			m_sink = sink;
+		}
+
+	protected:
+		void handle(const el::LogDispatchData* data) override
+		{
+			if (!m_sink || data->dispatchAction() != el::base::DispatchAction::NormalLog || routeLogLine(data))
+			{
+				return;
+			}
+			const auto* message = data->logMessage();
+			auto* logger = message->logger();
+			LogRecord record;
+			record.file = m_sink->getLogFile(logger, message->level());
+			record.toStandardOutput = logger->typedConfigurations()->toStandardOutput(message->level());
+			record.isLossless = message->level() == el::Level::Warning || message->level() == el::Level::Error ||
+				message->level() == el::Level::Fatal;
+			record.line = logger->logBuilder()->build(message, true);
+			m_sink->push(record);
+		}
+
+	private:
+		AsyncLogSink* m_sink = nullptr;
+	};
+}
+
+LogRing::LogRing(size_t capacity) :
+	m_records(capacity),
+	m_mask(capacity - 1),
+	m_head(0),
+	m_tail(0)
+{
+	if (capacity == 0 || (capacity & (capacity - 1)) != 0)
+	{
+		throw std::invalid_argument("Log ring capacity should be a power of two");
+	}
+}
+
+bool LogRing::tryPush(LogRecord& record)
+{
+	const size_t tail = m_tail.load(std::memory_order_relaxed);
+	if (tail - m_head.load(std::memory_order_acquire) == m_records.size())
+	{
+		return false;
+	}
+	m_records[tail & m_mask] = std::move(record);
+	m_tail.store(tail + 1, std::memory_order_release);
+	return true;
+}
+
+bool LogRing::tryPop(LogRecord& record)
+{
+	const size_t head = m_head.load(std::memory_order_relaxed);
+	if (head == m_tail.load(std::memory_order_acquire))
+	{
+		return false;
+	}
+	record = std::move(m_records[head & m_mask]);
+	m_head.store(head + 1, std::memory_order_release);
+	return true;
+}
+
+AsyncLogSink::AsyncLogSink(size_t recordsPerThread) :
+	m_sinkId(++g_lastSinkId),
+	m_recordsPerThread(recordsPerThread),
+	m_hadStrictFileSizeCheck(false),
+	m_isWriterWaiting(false),
+	m_needStop(false),
+	m_droppedRecords(0)
+{
+	m_backgroundWrite = std::make_unique<std::thread>(&AsyncLogSink::backgroundWriting, this);
+	{
+		// Dispatches are done under the global lock. So no line is written by both callbacks or by none of them
+		std::lock_guard<el::base::threading::Mutex> lock(ELPP->lock());
+		el::Helpers::installLogDispatchCallback<AsyncLogDispatchCallback>(ASYNC_CALLBACK_ID);
+		el::Helpers::logDispatchCallback<AsyncLogDispatchCallback>(ASYNC_CALLBACK_ID)->setSink(this);
+		el::Helpers::uninstallLogDispatchCallback<el::base::DefaultLogDispatchCallback>(DEFAULT_CALLBACK_ID);
+		// Files are rolled by the sink. The strict check would roll them on dispatches, while the sink writes them
+		m_hadStrictFileSizeCheck = el::Loggers::hasFlag(el::LoggingFlag::StrictLogFileSizeCheck);
+		el::Loggers::removeFlag(el::LoggingFlag::StrictLogFileSizeCheck);
+	}
+	LOG(INFO) << "Logs are written asynchronously";
+}
+
+AsyncLogSink::~AsyncLogSink()
+{
+	stop();
+}
+
+void AsyncLogSink::stop()
+{
+	if (m_needStop.exchange(true))
+		return;
+
+	{
+		// The rest of the lines of the process are written by the default dispatch.
+		// Logging threads wait on the global lock till the writer has written all records, so nothing is lost or reordered
+		std::lock_guard<el::base::threading::Mutex> lock(ELPP->lock());
+		el::Helpers::uninstallLogDispatchCallback<AsyncLogDispatchCallback>(ASYNC_CALLBACK_ID);
+		installDefaultLogDispatch();
+		{
+			std::lock_guard<decltype(m_wakeupMutex)> wakeupLock(m_wakeupMutex);
+		}
+		m_wakeupCV.notify_one();
+		m_backgroundWrite->join();
+		if (m_hadStrictFileSizeCheck)
+		{
+			el::Loggers::addFlag(el::LoggingFlag::StrictLogFileSizeCheck);
+		}
+	}
+	const uint64_t droppedRecords = m_droppedRecords;
+	if (droppedRecords)
+	{
+		LOG(WARNING) << "Asynchronous logging is stopped. " << droppedRecords << " lines are dropped on full rings";
+	}
+	else
+	{
+		LOG(INFO) << "Asynchronous logging is stopped";
+	}
+}
+
+LogFile* AsyncLogSink::getLogFile(el::Logger* logger, el::Level level)
+{
+	auto* configurations = logger->typedConfigurations();
+	if (!configurations->toFile(level))
+	{
+		return nullptr;
+	}
+	auto* stream = configurations->fileStream(level);
+	if (!stream)
+	{
+		return nullptr;
+	}
+	std::lock_guard<decltype(m_filesMutex)> lock(m_filesMutex);
+	for (auto& file : m_files)
+	{
+		if (file->stream == stream)
+		{
+			return file.get();
+		}
+	}
+	m_files.push_back(std::make_unique<LogFile>());
+	m_files.back()->stream = stream;
+	m_files.back()->fileName = configurations->filename(level);
+	m_files.back()->maxFileSize = configurations->maxLogFileSize(level);
+	return m_files.back().get();
+}
+
+LogRing& AsyncLogSink::getThreadRing()
+{
+	if (!t_ring || t_ringSinkId != m_sinkId)
+	{
+		t_ring = std::make_shared<LogRing>(m_recordsPerThread);
+		t_ringSinkId = m_sinkId;
+		std::lock_guard<decltype(m_ringsMutex)> lock(m_ringsMutex);
+		m_rings.push_back(t_ring);
+	}
+	return *t_ring;
+}
+
+void AsyncLogSink::push(LogRecord& record)
+{
+	auto& ring = getThreadRing();
+	if (!ring.tryPush(record))
+	{
+		if (record.isLossless)
+		{
+			writeSynchronously(ring, record);
+			return;
+		}
+		// The logging thread holds easylogging++'s locks here. A wait for the writer would stop all logging threads
+		m_droppedRecords.fetch_add(1, std::memory_order_relaxed);
+		m_wakeupCV.notify_one();
+		return;
+	}
+	// The writer is woken up only if it sleeps. So a busy writer costs nothing to logging threads
+	if (m_isWriterWaiting.load(std::memory_order_relaxed))
+	{
+		m_wakeupCV.notify_one();
+	}
+}
+
+void AsyncLogSink::writeSynchronously(LogRing& ring, const LogRecord& record)
+{
+	// The writer doesn't take easylogging++'s locks, so the wait for it is short.
+	// Pops are under the mutex, so the ring still has one consumer at a time
+	std::lock_guard<decltype(m_writeMutex)> lock(m_writeMutex);
+	LogRecord ringRecord;
+	while (ring.tryPop(ringRecord))
+	{
+		writeRecord(ringRecord);
+	}
+	writeRecord(record);
+}
+
+void AsyncLogSink::backgroundWriting()
+{
+	while (true)
+	{
+		std::unique_lock<decltype(m_writeMutex)> writeLock(m_writeMutex);
+		if (writeRecords() > 0)
+		{
+			continue;
+		}
+		flushFiles();
+		if (m_needStop)
+		{
+			// Records pushed before the stop request are written by the last pass
+			writeRecords();
+			flushFiles();
+			break;
+		}
+		writeLock.unlock();
+		std::unique_lock<decltype(m_wakeupMutex)> lock(m_wakeupMutex);
+		m_isWriterWaiting = true;
+		m_wakeupCV.wait_for(lock, WRITER_IDLE_TIMEOUT);
+		m_isWriterWaiting = false;
+	}
+}
+
+size_t AsyncLogSink::writeRecords()
+{
+	std::vector<std::shared_ptr<LogRing>> rings;
+	{
+		std::lock_guard<decltype(m_ringsMutex)> lock(m_ringsMutex);
+		rings = m_rings;
+	}
+	size_t writtenCount = 0;
+	LogRecord record;
+	for (auto& ring : rings)
+	{
+		while (ring->tryPop(record))
+		{
+			writeRecord(record);
+			++writtenCount;
+		}
+	}
+	return writtenCount;
+}
+
+void AsyncLogSink::writeRecord(const LogRecord& record)
+{
+	if (record.file)
+	{
+		record.file->stream->write(record.line.c_str(), record.line.size());
+		if (std::find(m_writtenFiles.begin(), m_writtenFiles.end(), record.file) == m_writtenFiles.end())
+		{
+			m_writtenFiles.push_back(record.file);
+		}
+	}
+	if (record.toStandardOutput)
+	{
+		std::cout << record.line;
+	}
+}
+
+void AsyncLogSink::flushFiles()
+{
+	for (auto* file : m_writtenFiles)
+	{
+		file->stream->flush();
+		const auto fileSize = file->stream->tellp();
+		if (file->maxFileSize && fileSize > 0 && static_cast<size_t>(fileSize) >= file->maxFileSize)
+		{
+			// The same rolling as TypedConfigurations::validateFileRolling() of easylogging++
+			file->stream->close();
+			ELPP->preRollOutCallback()(file->fileName.c_str(), static_cast<size_t>(fileSize));
+			file->stream->open(file->fileName, std::fstream::out | std::fstream::trunc);
+		}
+	}
+	m_writtenFiles.clear();
+}
+}
@@ -0,0 +1,110 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "easylogging++.h"
+
+namespace transformation_stream
+{
+// A log file of a logger's level. The sink's thread writes, flushes and rolls it without easylogging++'s locks
+struct LogFile
+{
+	el::base::type::fstream_t* stream = nullptr;
+	std::string fileName;
+	size_t maxFileSize = 0; // MAX_LOG_FILE_SIZE of logger.config. 0 - no rolling
+};
+
+// A log line which is built by a logging thread and written by the sink's thread.
+// Destinations are taken by the logging thread, so the sink's thread doesn't read configurations of loggers
+struct LogRecord
+{
+	std::string line;
+	LogFile* file = nullptr; // nullptr - not to file
+	bool toStandardOutput = false;
+	bool isLossless = false; // Warnings and errors are written by the logging thread if its ring is full
+};
+
+// A single producer single consumer ring of log records. The producer is one logging thread, the consumer is the sink
+class LogRing
+{
+public:
+	explicit LogRing(size_t capacity);
+
+	// It's false if the ring is full
+	bool tryPush(LogRecord& record);
+	bool tryPop(LogRecord& record);
+
+private:
+	std::vector<LogRecord> m_records;
+	const size_t m_mask;
+	std::atomic<size_t> m_head; // The next record to pop. The consumer only changes it
+	std::atomic<size_t> m_tail; // The next record to push. The producer only changes it
+};
+
+// An asynchronous backend of easylogging++. It replaces the default dispatch, which writes app.log under the file lock
+// by the logging thread. Logging threads build a line by logger.config and put it to their own ring.
+// A background thread writes lines of all rings to files of loggers and flushes them when rings are empty.
+// Lines of one thread keep their order, lines of different threads could be a bit reordered.
+// A logging thread doesn't wait for the writer while its ring has space: it logs under easylogging++'s locks.
+// On a full ring debug, trace and info lines are dropped. Warnings and errors are written by the logging thread
+// itself after the lines of its ring, so they aren't lost for a short stall.
+// Loggers shouldn't be reconfigured while the sink works, because it keeps their file streams.
+class AsyncLogSink
+{
+public:
+	explicit AsyncLogSink(size_t recordsPerThread = DEFAULT_RECORDS_PER_THREAD);
+
+	virtual ~AsyncLogSink();
+
+	// Writes all records and returns the default synchronous dispatch
+	void stop();
+
+	// It's called by the dispatch callback on a logging thread. If the thread's ring is full,
+	// a lossless record is written synchronously and others are dropped
+	void push(LogRecord& record);
+
+	// It's called by the dispatch callback on a logging thread
+	LogFile* getLogFile(el::Logger* logger, el::Level level);
+
+	static constexpr size_t DEFAULT_RECORDS_PER_THREAD = 1024;
+
+private:
+	LogRing& getThreadRing();
+
+	void backgroundWriting();
+
+	// Returns the count of written records
+	size_t writeRecords();
+
+	// It's called under m_writeMutex
+	void writeRecord(const LogRecord& record);
+
+	// Writes records of the thread's ring and the record by the logging thread
+	void writeSynchronously(LogRing& ring, const LogRecord& record);
+
+	// Flushes written files and rolls them like easylogging++ does on its flushes
+	void flushFiles();
+
+	const uint64_t m_sinkId;
+	const size_t m_recordsPerThread;
+	std::mutex m_ringsMutex;
+	std::vector<std::shared_ptr<LogRing>> m_rings;
+	std::mutex m_filesMutex;
+	std::vector<std::unique_ptr<LogFile>> m_files;
+	// Pops of rings, writes and flushes of files. The writer holds it, a logging thread takes it on a full ring only
+	std::mutex m_writeMutex;
+	std::vector<LogFile*> m_writtenFiles; // Files to flush
+	bool m_hadStrictFileSizeCheck;
+
+	std::mutex m_wakeupMutex;
+	std::condition_variable m_wakeupCV;
+	std::atomic<bool> m_isWriterWaiting;
+	std::atomic<bool> m_needStop;
+	std::atomic<uint64_t> m_droppedRecords;
+	std::unique_ptr<std::thread> m_backgroundWrite;
+};
+}
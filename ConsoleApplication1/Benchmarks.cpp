@@ -0,0 +1,970 @@
+#include "Benchmarks.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <random>
+#include <thread>
+#include <functional>
+#include <iomanip>
+#include <stdexcept>
+#include <vector>
+#include "easylogging++.h"
+#include "AllocationCounter.h"
+#include "HotLog.h"
+#include "LockingQueue.h"
+#include "MemBlocksPool.h"
+#include "MD5SignatureCalculationStrategy.h"
+#include "TransformationEngine.h"
+#include "ReadStreamBuffer.h"
+#include "WriteSteamBuffer.h"
+#include "Signer.h"
+
+namespace transformation_stream
+{
+namespace
+{
+	struct BenchmarkResult
+	{
+		BenchmarkResult(const std::string& name, uint64_t iterations, double nsPerOperation, uint64_t bytesPerOperation = 0) :
+			name(name), iterations(iterations), nsPerOperation(nsPerOperation), bytesPerOperation(bytesPerOperation)
+		{
+		}
+
+		std::string name;
+		uint64_t iterations;
+		double nsPerOperation;
+		uint64_t bytesPerOperation; // For GB/s. 0 - it's not printed
+		std::string note;
+		double allocationsPerOperation = -1; // Heap allocations of all threads per operation. -1 - it's not measured
+		bool isAllocationFree = false; // The suite fails if the benchmark allocates
+		// Pool gets which allocated after the warm up and blocks which weren't returned to pools.
+		// An allocation free benchmark fails on them
+		uint64_t poolMissesCount = 0;
+	};
+
+	// -1 if allocations aren't counted by this build (see FS_COUNT_ALLOCATIONS)
+	double allocationsSince(uint64_t startAllocations, uint64_t operations)
+	{
+		if (!isAllocationsCountingEnabled())
+		{
+			return -1;
+		}
+		return static_cast<double>(getAllocationsCount() - startAllocations) / operations;
+	}
+
+	// Runs the operation iterations times after a short warm up
+	BenchmarkResult measure(const std::string& name, uint64_t iterations, const std::function<void(uint64_t)>& operation)
+	{
+		for (uint64_t i = 0; i < iterations / 100; ++i)
+		{
+			operation(i);
+		}
+		const uint64_t startAllocations = getAllocationsCount();
+		const auto start = std::chrono::steady_clock::now();
+		for (uint64_t i = 0; i < iterations; ++i)
+		{
+			operation(i);
+		}
+		const double ns = static_cast<double>(
+			std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+		// Before the result: its name is allocated
+		const double allocationsPerOperation = allocationsSince(startAllocations, iterations);
+		BenchmarkResult result = { name, iterations, ns / iterations };
+		result.allocationsPerOperation = allocationsPerOperation;
+		return result;
+	}
+
+	// Runs the operation until minSeconds are passed. The operation is repeated, so it should restore its state itself.
+	// The state could repeat by cycles of cycleLength calls (a flush per 64 blocks). One cycle warms up,
+	// then whole cycles are measured. So allocations per operation don't depend on the count of calls in minSeconds
+	BenchmarkResult measureFor(const std::string& name, double minSeconds, uint64_t cycleLength, const std::function<void()>& operation)
+	{
+		for (uint64_t i = 0; i < cycleLength; ++i)
+		{
+			operation();
+		}
+		uint64_t iterations = 0;
+		const uint64_t startAllocations = getAllocationsCount();
+		const auto start = std::chrono::steady_clock::now();
+		uint64_t elapsedNs = 0;
+		do
+		{
+			operation();
+			++iterations;
+			elapsedNs = nanosecondsSince(start);
+		} while (elapsedNs < minSeconds * 1e9 || iterations % cycleLength != 0);
+		const double allocationsPerOperation = allocationsSince(startAllocations, iterations);
+		BenchmarkResult result = { name, iterations, static_cast<double>(elapsedNs) / iterations };
+		result.allocationsPerOperation = allocationsPerOperation;
+		return result;
+	}
+
+	const double GB = 1024.0 * 1024.0 * 1024.0;
+
+	// Debug logs are enabled in logger.config, but benchmarks measure code, not log writes
+	class ScopedDebugLogsOff
+	{
+	public:
+		ScopedDebugLogsOff() :
+			m_isDebugEnabled(el::Loggers::getLogger("default")->typedConfigurations()->enabled(el::Level::Debug))
+		{
+			el::Loggers::reconfigureAllLoggers(el::Level::Debug, el::ConfigurationType::Enabled, "false");
+		}
+
+		~ScopedDebugLogsOff()
+		{
+			el::Loggers::reconfigureAllLoggers(el::Level::Debug, el::ConfigurationType::Enabled, m_isDebugEnabled ? "true" : "false");
+		}
+
+	private:
+		const bool m_isDebugEnabled;
+	};
+
+	// "-" if allocations aren't measured
+	std::string toAllocationsText(double allocationsPerOperation)
+	{
+		if (allocationsPerOperation < 0)
+		{
+			return "-";
+		}
+		std::stringstream text;
+		text << std::fixed << std::setprecision(3) << allocationsPerOperation;
+		return text.str();
+	}
+
+	void printResults(const std::vector<BenchmarkResult>& results, std::ostream& out)
+	{
+		out << std::left << std::setw(40) << "benchmark" << std::right << std::setw(12) << "iterations"
+			<< std::setw(14) << "ns/op" << std::setw(10) << "GB/s" << std::setw(12) << "allocs/op" << "  note\n";
+		for (const auto& result : results)
+		{
+			out << std::left << std::setw(40) << result.name << std::right << std::setw(12) << result.iterations
+				<< std::setw(14) << std::fixed << std::setprecision(2) << result.nsPerOperation << std::setw(10);
+			if (result.bytesPerOperation)
+			{
+				out << std::setprecision(3) << result.bytesPerOperation / GB / (result.nsPerOperation / 1e9);
+			}
+			else
+			{
+				out << "-";
+			}
+			out << std::setw(12) << toAllocationsText(result.allocationsPerOperation) << "  " << result.note << "\n";
+		}
+		out << std::flush;
+	}
+
+	std::string toSizeName(size_t size)
+	{
+		if (size >= 1024 * 1024 && size % (1024 * 1024) == 0)
+			return std::to_string(size / (1024 * 1024)) + "MB";
+		if (size >= 1024 && size % 1024 == 0)
+			return std::to_string(size / 1024) + "KB";
+		return std::to_string(size) + "B";
+	}
+
+	const size_t QUEUE_BLOCK_SIZES[] = { 64, 4 * 1024, 64 * 1024, 1024 * 1024 };
+
+	// One producer streams blocks to one consumer. The consumer returns blocks to the pool like the strategy does.
+	// The time in queue of this mode includes waits of the full queue
+	BenchmarkResult runQueueThroughput(size_t blockSize)
+	{
+		const uint64_t blocksCount = std::max<uint64_t>(1000, std::min<uint64_t>(200000, static_cast<uint64_t>(GB / blockSize)));
+		const size_t queueSize = std::max<size_t>(16 * blockSize, 1024 * 1024);
+		const size_t queuedCount = queueSize / blockSize;
+		// The full queue and a block at each end
+		MemBlocksPool pool(queuedCount + 2);
+		LockingQueue queue(queueSize, "BenchQueue");
+		// Warm up out of the measure: the pool gets all blocks and the queue's ring gets its high water.
+		// Otherwise allocations per block would depend on how far the producer gets ahead
+		{
+			std::vector<BlockPTR> blocks;
+			for (size_t i = 0; i < queuedCount + 2; ++i)
+			{
+				blocks.push_back(pool.get(blockSize));
+			}
+			for (size_t i = 0; i < queuedCount; ++i)
+			{
+				queue.push(std::move(blocks[i]), false);
+			}
+			for (size_t i = 0; i < queuedCount; ++i)
+			{
+				blocks[i] = queue.pop();
+			}
+			for (auto& block : blocks)
+			{
+				pool.push(std::move(block));
+			}
+		}
+		const uint64_t startAllocations = getAllocationsCount();
+		const auto start = std::chrono::steady_clock::now();
+		std::thread consumer([&]() {
+			while (BlockPTR block = queue.pop())
+			{
+				pool.push(std::move(block));
+			}
+		});
+		for (uint64_t i = 0; i < blocksCount; ++i)
+		{
+			queue.push(pool.get(blockSize), false);
+		}
+		queue.stopIncomes();
+		consumer.join();
+		const double allocationsPerOperation = allocationsSince(startAllocations, blocksCount);
+		BenchmarkResult result = { "queue/throughput/" + toSizeName(blockSize), blocksCount,
+			static_cast<double>(nanosecondsSince(start)) / blocksCount, blockSize };
+		result.allocationsPerOperation = allocationsPerOperation;
+		result.note = "time in queue " + queue.getCounters().timeInQueue.toString();
+		return result;
+	}
+
+	// A block is passed to another thread and back by two queues. A handoff is a half of the round trip
+	BenchmarkResult runQueuePingPong(size_t blockSize)
+	{
+		const uint64_t roundTrips = 20000;
+		LockingQueue there(std::max<size_t>(blockSize, 1024), "BenchThere");
+		LockingQueue back(std::max<size_t>(blockSize, 1024), "BenchBack");
+		std::thread echo([&]() {
+			while (BlockPTR block = there.pop())
+			{
+				back.push(std::move(block), false);
+			}
+			back.stopIncomes();
+		});
+		BlockPTR block = make_unique<BlockT>(blockSize);
+		const uint64_t startAllocations = getAllocationsCount();
+		const auto start = std::chrono::steady_clock::now();
+		for (uint64_t i = 0; i < roundTrips; ++i)
+		{
+			there.push(std::move(block), false);
+			block = back.pop();
+		}
+		const uint64_t elapsedNs = nanosecondsSince(start);
+		there.stopIncomes();
+		echo.join();
+		const double allocationsPerOperation = allocationsSince(startAllocations, 2 * roundTrips);
+		BenchmarkResult result = { "queue/handoff/" + toSizeName(blockSize), 2 * roundTrips,
+			static_cast<double>(elapsedNs) / (2 * roundTrips) };
+		result.allocationsPerOperation = allocationsPerOperation;
+		result.note = "time in queue " + there.getCounters().timeInQueue.toString();
+		return result;
+	}
+
+	std::vector<BenchmarkResult> runQueueSuite()
+	{
+		std::vector<BenchmarkResult> results;
+		for (auto blockSize : QUEUE_BLOCK_SIZES)
+		{
+			results.push_back(runQueueThroughput(blockSize));
+		}
+		for (auto blockSize : QUEUE_BLOCK_SIZES)
+		{
+			results.push_back(runQueuePingPong(blockSize));
+		}
+		return results;
+	}
+
+	// Threads get a block from one pool and return it. ns/op is the wall time per get and push pair of all threads
+	std::vector<BenchmarkResult> runPoolSuite()
+	{
+		const uint64_t PAIRS_PER_THREAD = 500000;
+		const size_t BLOCK_SIZE = 64 * 1024;
+		std::vector<BenchmarkResult> results;
+		for (size_t threadsCount : { 1, 2, 4, 8 })
+		{
+			MemBlocksPool pool(64);
+			std::vector<std::thread> threads;
+			threads.reserve(threadsCount);
+			const uint64_t startAllocations = getAllocationsCount();
+			const auto start = std::chrono::steady_clock::now();
+			for (size_t t = 0; t < threadsCount; ++t)
+			{
+				threads.emplace_back([&pool, BLOCK_SIZE, PAIRS_PER_THREAD]() {
+					for (uint64_t i = 0; i < PAIRS_PER_THREAD; ++i)
+					{
+						pool.push(pool.get(BLOCK_SIZE));
+					}
+				});
+			}
+			for (auto& thread : threads)
+			{
+				thread.join();
+			}
+			const uint64_t pairsCount = PAIRS_PER_THREAD * threadsCount;
+			// Thread starts are counted too, but they are negligible against the pairs
+			const double allocationsPerOperation = allocationsSince(startAllocations, pairsCount);
+			BenchmarkResult result = { "pool/get+push/threads:" + std::to_string(threadsCount), pairsCount,
+				static_cast<double>(nanosecondsSince(start)) / pairsCount };
+			result.allocationsPerOperation = allocationsPerOperation;
+			const auto& counters = pool.getCounters();
+			result.note = "hit rate " + std::to_string(static_cast<double>(counters.hits) / counters.gets);
+			results.push_back(result);
+		}
+		return results;
+	}
+
+	// One transform call per block. A digest is calculated per block like --blocksize is equal to the block
+	std::vector<BenchmarkResult> runMD5Suite()
+	{
+		const double MIN_SECONDS = 0.3;
+		std::vector<BenchmarkResult> results;
+		// Digests are flushed per 64 blocks, but not rarer then per MB. So the warm up cycle of large blocks is short
+		const size_t FLUSH_BYTES = 1024 * 1024;
+		for (size_t blockSize = 512; blockSize <= 64 * 1024 * 1024; blockSize = (blockSize == 32 * 1024 * 1024) ? 2 * blockSize : 4 * blockSize)
+		{
+			MemBlocksPool pool(4);
+			LockingQueue digests(1024 * 1024, "BenchDigests");
+			MD5SignatureCalculationStrategy strategy(digests, pool, blockSize);
+			std::vector<BlockPTR> batch;
+			const uint64_t flushPeriod = std::max<size_t>(1, std::min<size_t>(64, FLUSH_BYTES / blockSize));
+			uint64_t transformedCount = 0;
+			auto result = measureFor("md5/transform/" + toSizeName(blockSize), MIN_SECONDS, flushPeriod, [&]() {
+				strategy.transform(pool.get(blockSize));
+				// Digests are returned to the strategy like a writer does it
+				if (++transformedCount % flushPeriod == 0)
+				{
+					strategy.flush();
+					batch.clear();
+					digests.popBatch(batch, SIZE_MAX, SIZE_MAX);
+					for (auto& digest : batch)
+					{
+						strategy.getDigestPool().push(std::move(digest));
+					}
+				}
+			});
+			result.bytesPerOperation = blockSize;
+			result.note = "tile " + toSizeName(MD5SignatureCalculationStrategy::DEFAULT_TILE_SIZE);
+			results.push_back(result);
+		}
+		return results;
+	}
+
+	void append(std::vector<BenchmarkResult>& results, const std::vector<BenchmarkResult>& suiteResults)
+	{
+		results.insert(results.end(), suiteResults.begin(), suiteResults.end());
+	}
+	// MD5 digest block
+	const size_t DIGEST_SIZE = 16;
+	// Synthetic data is cycled from a source of this size. It's larger then caches like a file would be
+	const size_t SYNTHETIC_SOURCE_SIZE = 64 * 1024 * 1024;
+	const size_t PATTERN_SIZE = 4096;
+
+	BlockT makeSyntheticData(const std::string& kind)
+	{
+		BlockT data(SYNTHETIC_SOURCE_SIZE, 0);
+		std::mt19937_64 generator(42);
+		if (kind == "random")
+		{
+			for (size_t i = 0; i + sizeof(uint64_t) <= data.size(); i += sizeof(uint64_t))
+			{
+				const uint64_t value = generator();
+				memcpy(&data[i], &value, sizeof(value));
+			}
+		}
+		else if (kind == "pattern")
+		{
+			for (size_t i = 0; i < PATTERN_SIZE; ++i)
+			{
+				data[i] = static_cast<char_type>(generator());
+			}
+			for (size_t i = PATTERN_SIZE; i < data.size(); ++i)
+			{
+				data[i] = data[i % PATTERN_SIZE];
+			}
+		}
+		return data;
+	}
+
+	// Returns digests to the pool like a writer to /dev/null
+	void drainQueue(IStreamQueue& queue, IMemBlocksPool& digestPool)
+	{
+		std::vector<BlockPTR> batch;
+		batch.reserve(TransformationEngine::MAX_BATCH_BLOCKS);
+		while (!queue.isInputStopped())
+		{
+			batch.clear();
+			queue.popBatch(batch, TransformationEngine::MAX_BATCH_BLOCKS, SIZE_MAX);
+			for (auto& digest : batch)
+			{
+				digestPool.push(std::move(digest));
+			}
+		}
+	}
+
+	struct HashRunResult
+	{
+		double wallSeconds;
+		uint64_t hashBusyNs;
+	};
+
+	// One conveyer run like FileSignature's one, but the reader copies blocks from memory and the writer drops digests
+	HashRunResult runHashConveyer(const HashBenchmarkSettings& settings, const BlockT& source, size_t tileSize)
+	{
+		const size_t batchMaxBytes = settings.maxBufferSize / 2;
+		MemBlocksPool memPool((settings.maxBufferSize + batchMaxBytes) / settings.ioBlockSize + 1);
+		LockingQueue inputQueue(settings.maxBufferSize, "BenchInQueue");
+		LockingQueue outputQueue(settings.maxBufferSize, "BenchOutQueue");
+		MD5SignatureCalculationStrategy strategy(outputQueue, memPool, settings.sampleSize, tileSize);
+		TransformationEngine engine(inputQueue, outputQueue, strategy, batchMaxBytes);
+
+		const auto start = std::chrono::steady_clock::now();
+		std::thread reader([&]() {
+			size_t sourceShift = 0;
+			for (uint64_t restBytes = settings.totalBytes; restBytes > 0; )
+			{
+				const size_t blockSize = static_cast<size_t>(std::min<uint64_t>(settings.ioBlockSize, restBytes));
+				BlockPTR block = memPool.get(blockSize);
+				for (size_t copied = 0; copied < blockSize; )
+				{
+					const size_t portion = std::min(blockSize - copied, source.size() - sourceShift);
+					memcpy(&(*block)[copied], &source[sourceShift], portion);
+					copied += portion;
+					sourceShift = (sourceShift + portion) % source.size();
+				}
+				inputQueue.push(std::move(block), false);
+				restBytes -= blockSize;
+			}
+			inputQueue.stopIncomes();
+		});
+		std::thread writer([&]() { drainQueue(outputQueue, strategy.getDigestPool()); });
+		engine.transform();
+		reader.join();
+		writer.join();
+		return { nanosecondsSince(start) / 1e9, strategy.getCounters().busyNs };
+	}
+
+	// The whole conveyer with the default IO settings on random in-memory data. An operation is an IO block
+	std::vector<BenchmarkResult> runConveyerSuite()
+	{
+		const size_t IO_BLOCK_SIZE = 1024 * 1024;
+		const size_t MAX_BUFFER_SIZE = 3 * 1024 * 1024;
+		const uint64_t TOTAL_BYTES = 256 * 1024 * 1024;
+		const BlockT source = makeSyntheticData("random");
+		std::vector<BenchmarkResult> results;
+		for (size_t sampleSize : { 4 * 1024, 1024 * 1024 })
+		{
+			const auto run = runHashConveyer({ sampleSize, IO_BLOCK_SIZE, MAX_BUFFER_SIZE, 0, TOTAL_BYTES }, source, 0);
+			const uint64_t blocksCount = TOTAL_BYTES / IO_BLOCK_SIZE;
+			BenchmarkResult result = { "conveyer/md5/blocksize:" + toSizeName(sampleSize), blocksCount,
+				run.wallSeconds * 1e9 / blocksCount, IO_BLOCK_SIZE };
+			// Allocations aren't set: pools grow here to their high water by timings of threads, so the count differs
+			// by runs up to twice. The steady suite checks allocations of the conveyer
+			result.note = std::to_string(IO_BLOCK_SIZE / sampleSize) + " digests per block";
+			results.push_back(result);
+		}
+		return results;
+	}
+
+	struct BaselineEntry
+	{
+		double nsPerOperation;
+		double allocationsPerOperation;
+	};
+	using Baseline = std::map<std::string, BaselineEntry>;
+
+	// Benchmarks with threads allocate a bit by timings (thread starts, waits). So an excess under
+	// the relative tolerance and the slack is not a new allocation on the path
+	const double ALLOCATIONS_TOLERANCE = 0.05;
+	const double ALLOCATIONS_SLACK = 0.05;
+
+	// A text file. Lines are "name<TAB>ns/op<TAB>allocs/op", names have spaces. Lines started with # are comments
+	Baseline readBaseline(const std::string& fileName)
+	{
+		std::ifstream file(fileName);
+		if (!file)
+		{
+			throw std::invalid_argument("Can't open benchmark baseline " + fileName);
+		}
+		Baseline baseline;
+		std::string line;
+		for (size_t lineNumber = 1; std::getline(file, line); ++lineNumber)
+		{
+			if (line.empty() || line[0] == '#')
+			{
+				continue;
+			}
+			std::stringstream lineStream(line);
+			std::string name;
+			BaselineEntry entry;
+			if (!std::getline(lineStream, name, '\t') || !(lineStream >> entry.nsPerOperation >> entry.allocationsPerOperation))
+			{
+				throw std::invalid_argument("Wrong benchmark baseline " + fileName + " at line " + std::to_string(lineNumber));
+			}
+			baseline[name] = entry;
+		}
+		return baseline;
+	}
+
+	void writeBaseline(const std::string& fileName, const std::vector<BenchmarkResult>& results)
+	{
+		std::ofstream file(fileName);
+		file << "# Benchmark baseline of FileSignature --bench. It's valid for the machine and the build it's made by\n"
+			<< "# name\tns/op\tallocs/op (-1 - not measured)\n";
+		for (const auto& result : results)
+		{
+			file << result.name << '\t' << std::fixed << std::setprecision(2) << result.nsPerOperation
+				<< '\t' << std::setprecision(3) << result.allocationsPerOperation << '\n';
+		}
+		if (!file.flush())
+		{
+			throw std::runtime_error("Can't write benchmark baseline " + fileName);
+		}
+	}
+
+	// Prints a comparison of results with the baseline. Returns false if any benchmark regressed.
+	// Benchmarks which are not in the baseline are reported as new and don't fail the check.
+	// Baseline entries of suites which were not run are listed too, so a renamed benchmark is seen
+	bool checkBaseline(const Baseline& baseline, const std::vector<BenchmarkResult>& results, double tolerance, std::ostream& out)
+	{
+		out << "\nComparison with the baseline. Tolerance " << std::fixed << std::setprecision(0) << tolerance * 100 << "%\n"
+			<< std::left << std::setw(40) << "benchmark" << std::right << std::setw(14) << "base ns/op" << std::setw(14) << "ns/op"
+			<< std::setw(10) << "change" << std::setw(12) << "base allocs" << std::setw(12) << "allocs" << "  status\n";
+		size_t regressionsCount = 0;
+		for (const auto& result : results)
+		{
+			out << std::left << std::setw(40) << result.name << std::right;
+			const auto entry = baseline.find(result.name);
+			if (entry == baseline.end())
+			{
+				out << std::setw(14) << "-" << std::setw(14) << std::setprecision(2) << result.nsPerOperation
+					<< std::setw(10) << "-" << std::setw(12) << "-" << std::setw(12)
+					<< toAllocationsText(result.allocationsPerOperation) << "  new\n";
+				continue;
+			}
+			const auto& base = entry->second;
+			const bool isSlower = result.nsPerOperation > base.nsPerOperation * (1 + tolerance);
+			const bool isAllocationsMeasured = base.allocationsPerOperation < 0 || result.allocationsPerOperation >= 0;
+			const bool isAllocating = base.allocationsPerOperation >= 0 && isAllocationsMeasured &&
+				result.allocationsPerOperation > base.allocationsPerOperation * (1 + ALLOCATIONS_TOLERANCE) + ALLOCATIONS_SLACK;
+			const double change = base.nsPerOperation > 0 ? (result.nsPerOperation / base.nsPerOperation - 1) * 100 : 0;
+			out << std::setw(14) << std::setprecision(2) << base.nsPerOperation << std::setw(14) << result.nsPerOperation
+				<< std::setw(9) << std::showpos << std::setprecision(1) << change << std::noshowpos << "%"
+				<< std::setw(12) << toAllocationsText(base.allocationsPerOperation)
+				<< std::setw(12) << toAllocationsText(result.allocationsPerOperation) << "  "
+				<< (isSlower ? (isAllocating ? "SLOWER, MORE ALLOCATIONS" : "SLOWER") : (isAllocating ? "MORE ALLOCATIONS" : "ok"))
+				<< (isAllocationsMeasured ? "" : ", allocations aren't counted by this build") << "\n";
+			if (isSlower || isAllocating)
+			{
+				++regressionsCount;
+			}
+		}
+		for (const auto& entry : baseline)
+		{
+			const bool isRun = std::any_of(results.begin(), results.end(),
+				[&entry](const BenchmarkResult& result) { return result.name == entry.first; });
+			if (!isRun)
+			{
+				out << std::left << std::setw(40) << entry.first << std::right << std::setw(14) << std::setprecision(2)
+					<< entry.second.nsPerOperation << std::setw(14) << "-" << std::setw(10) << "-" << std::setw(12)
+					<< toAllocationsText(entry.second.allocationsPerOperation) << std::setw(12) << "-" << "  not run\n";
+			}
+		}
+		out << (regressionsCount ? std::to_string(regressionsCount) + " benchmarks regressed" : "No regressions") << std::endl;
+		return regressionsCount == 0;
+	}
+
+	struct ConveyerRunAllocations
+	{
+		uint64_t allocationsCount;
+		uint64_t blockMissesCount; // Gets which allocated a block
+		uint64_t digestMissesCount; // Gets which allocated a digest
+		uint64_t lostCount; // Blocks and digests which were got from the pools but not returned
+	};
+
+	uint64_t getPoolMisses(const MemBlocksPool& pool)
+	{
+		return pool.getCounters().gets - pool.getCounters().hits;
+	}
+
+	// A lost block is a miss of a next run. A prefilled pool could hide it for a few runs, so it's checked itself
+	int64_t getPoolBalance(const MemBlocksPool& pool)
+	{
+		return static_cast<int64_t>(pool.getCounters().gets) - static_cast<int64_t>(pool.getCounters().returns);
+	}
+
+	// Allocations of one signature of the file by the whole conveyer like FileSignature's one:
+	// ReadStream, the queues, the pools, TransformationEngine, the MD5 strategy and WriteStream.
+	// The pools live between runs like Signer's ones. Queues are made per run with reserved slots for all blocks they fit
+	ConveyerRunAllocations countConveyerAllocations(const std::string& source, const std::string& result, size_t sampleSize,
+		size_t ioBlockSize, size_t maxBufferSize, MemBlocksPool& memPool, MemBlocksPool& digestPool)
+	{
+		const uint64_t startAllocations = getAllocationsCount();
+		const uint64_t startBlockMisses = getPoolMisses(memPool);
+		const uint64_t startDigestMisses = getPoolMisses(digestPool);
+		const int64_t startBalance = getPoolBalance(memPool) + getPoolBalance(digestPool);
+		{
+			const size_t batchMaxBytes = maxBufferSize / 2;
+			LockingQueue inputQueue(maxBufferSize, "BenchInQueue");
+			LockingQueue outputQueue(maxBufferSize, "BenchOutQueue");
+			inputQueue.reserve(maxBufferSize / ioBlockSize);
+			outputQueue.reserve(maxBufferSize / DIGEST_SIZE);
+			MD5SignatureCalculationStrategy strategy(outputQueue, memPool, sampleSize,
+				MD5SignatureCalculationStrategy::DEFAULT_TILE_SIZE, &digestPool);
+			ReadStream inputStream(source, inputQueue, memPool, ioBlockSize);
+			WriteStream outputStream(result, outputQueue, ioBlockSize, ThreadPlacement(), &digestPool);
+			TransformationEngine engine(inputQueue, outputQueue, strategy, batchMaxBytes);
+			engine.transform();
+			outputStream.waitClose();
+		}
+		const uint64_t allocationsCount = getAllocationsCount() - startAllocations;
+		const int64_t balance = getPoolBalance(memPool) + getPoolBalance(digestPool) - startBalance;
+		return { allocationsCount, getPoolMisses(memPool) - startBlockMisses, getPoolMisses(digestPool) - startDigestMisses,
+			static_cast<uint64_t>(std::max<int64_t>(balance, 0)) };
+	}
+
+	void writeSyntheticFile(const std::string& fileName, const BlockT& source, uint64_t size)
+	{
+		std::ofstream file(fileName, std::ios::binary | std::ios::trunc);
+		for (uint64_t written = 0; written < size; )
+		{
+			const size_t portion = static_cast<size_t>(std::min<uint64_t>(source.size(), size - written));
+			file.write(reinterpret_cast<const char*>(source.data()), portion);
+			written += portion;
+		}
+		if (!file.flush())
+		{
+			throw std::runtime_error("Can't write benchmark file " + fileName);
+		}
+	}
+
+	// Allocations per IO block of the whole conveyer in its steady state. The conveyer signs a short and a long file,
+	// so allocations of the start and the end are the same and the difference is made by the steady state only.
+	// Pools are prefilled and a run is made before the measure. It's the warm up, its allocations aren't counted.
+	// Measured runs shouldn't miss the pools or lose their blocks, and the difference should be 0: blocks, digests,
+	// queue slots and batches are reused
+	std::vector<BenchmarkResult> runSteadyStateSuite()
+	{
+		const size_t IO_BLOCK_SIZE = 64 * 1024;
+		const size_t MAX_BUFFER_SIZE = 1024 * 1024;
+		const uint64_t SHORT_FILE_SIZE = 16 * 1024 * 1024;
+		const uint64_t LONG_FILE_SIZE = 48 * 1024 * 1024;
+		const size_t RUNS_COUNT = 3;
+		const std::string shortFile = "bench_steady_short.bin", longFile = "bench_steady_long.bin", resultFile = "bench_steady.sig";
+		const BlockT source = makeSyntheticData("random");
+		writeSyntheticFile(shortFile, source, SHORT_FILE_SIZE);
+		writeSyntheticFile(longFile, source, LONG_FILE_SIZE);
+		const uint64_t blocksCount = (LONG_FILE_SIZE - SHORT_FILE_SIZE) / IO_BLOCK_SIZE;
+		std::vector<BenchmarkResult> results;
+		for (size_t sampleSize : { 4 * 1024, 64 * 1024, 1024 * 1024 })
+		{
+			// Blocks of the input queue, of a batch of the engine and of the reader
+			MemBlocksPool memPool((MAX_BUFFER_SIZE + MAX_BUFFER_SIZE / 2) / IO_BLOCK_SIZE + 1);
+			MemBlocksPool digestPool(MD5SignatureCalculationStrategy::MAX_POOLED_DIGESTS);
+			memPool.prefill(IO_BLOCK_SIZE);
+			digestPool.prefill(DIGEST_SIZE);
+			countConveyerAllocations(shortFile, resultFile, sampleSize, IO_BLOCK_SIZE, MAX_BUFFER_SIZE, memPool, digestPool);
+
+			uint64_t shortAllocations = UINT64_MAX, longAllocations = UINT64_MAX;
+			uint64_t longNs = UINT64_MAX;
+			uint64_t blockMissesCount = 0, digestMissesCount = 0, lostCount = 0;
+			for (size_t run = 0; run < RUNS_COUNT; ++run)
+			{
+				const auto shortRun = countConveyerAllocations(shortFile, resultFile, sampleSize, IO_BLOCK_SIZE, MAX_BUFFER_SIZE,
+					memPool, digestPool);
+				const auto start = std::chrono::steady_clock::now();
+				const auto longRun = countConveyerAllocations(longFile, resultFile, sampleSize, IO_BLOCK_SIZE, MAX_BUFFER_SIZE,
+					memPool, digestPool);
+				longNs = std::min(longNs, nanosecondsSince(start));
+				shortAllocations = std::min(shortAllocations, shortRun.allocationsCount);
+				longAllocations = std::min(longAllocations, longRun.allocationsCount);
+				blockMissesCount += shortRun.blockMissesCount + longRun.blockMissesCount;
+				digestMissesCount += shortRun.digestMissesCount + longRun.digestMissesCount;
+				lostCount += shortRun.lostCount + longRun.lostCount;
+			}
+			BenchmarkResult result = { "steady/conveyer/blocksize:" + toSizeName(sampleSize), blocksCount,
+				static_cast<double>(longNs) / (LONG_FILE_SIZE / IO_BLOCK_SIZE), IO_BLOCK_SIZE };
+			result.allocationsPerOperation = longAllocations > shortAllocations ?
+				static_cast<double>(longAllocations - shortAllocations) / blocksCount : 0;
+			result.isAllocationFree = true;
+			result.poolMissesCount = blockMissesCount + digestMissesCount + lostCount;
+			result.note = "file read and write, " + std::to_string(longAllocations) + " allocations per run, " +
+				std::to_string(blockMissesCount) + " block and " + std::to_string(digestMissesCount) + " digest pool misses, " +
+				std::to_string(lostCount) + " not returned";
+			results.push_back(result);
+		}
+		std::remove(shortFile.c_str());
+		std::remove(longFile.c_str());
+		std::remove(resultFile.c_str());
+		return results;
+	}
+
+	// Repeated in-process signatures of small files by one Signer. It's the cost of a call without a process start
+	std::vector<BenchmarkResult> runSignerSuite()
+	{
+		const double MIN_SECONDS = 0.5;
+		const std::string sourceFile = "bench_signer.bin";
+		const BlockT source = makeSyntheticData("random");
+		std::vector<BenchmarkResult> results;
+		Signer signer;
+		for (uint64_t fileSize : { 64 * 1024, 1024 * 1024, 16 * 1024 * 1024 })
+		{
+			writeSyntheticFile(sourceFile, source, fileSize);
+			SignerSettings settings;
+			settings.sampleSize = 64 * 1024;
+			settings.ioBlockSize = 64 * 1024;
+			settings.maxBufferSize = 1024 * 1024;
+			std::vector<Digest> digests;
+			digests.reserve(static_cast<size_t>(fileSize / settings.sampleSize));
+			auto result = measureFor("signer/sign/" + toSizeName(static_cast<size_t>(fileSize)), MIN_SECONDS, 1, [&]() {
+				digests.clear();
+				signer.sign(sourceFile, settings, [&digests](uint64_t, const Digest& digest) { digests.push_back(digest); });
+			});
+			result.bytesPerOperation = fileSize;
+			result.note = std::to_string(digests.size()) + " digests per call";
+			results.push_back(result);
+		}
+		std::remove(sourceFile.c_str());
+		return results;
+	}
+
+	// Calls which would wait for a busy signer forever should throw. A hang here is a failure too
+	bool checkSignerMisuse(std::ostream& out)
+	{
+		const std::vector<char_type> data(256 * 1024, 0x5a);
+		SignerSettings settings;
+		settings.sampleSize = 64 * 1024;
+		settings.ioBlockSize = 64 * 1024;
+		settings.maxBufferSize = 256 * 1024;
+		const DigestCallback ignore = [](uint64_t, const Digest&) {};
+		Signer signer;
+		size_t failsCount = 0;
+		auto expectLogicError = [&out, &failsCount](const std::string& name, const std::function<void()>& call) {
+			try
+			{
+				call();
+			}
+			catch (const std::logic_error&)
+			{
+				return;
+			}
+			catch (const std::exception& e)
+			{
+				out << "Signer check '" << name << "' failed by another error: " << e.what() << "\n";
+				++failsCount;
+				return;
+			}
+			out << "Signer check '" << name << "' failed: the call is done without an error\n";
+			++failsCount;
+		};
+		{
+			auto push = signer.startPush(settings, ignore);
+			push->write(data.data(), data.size());
+			expectLogicError("buffer signature while a push is live", [&]() { signer.sign(data.data(), data.size(), settings, ignore); });
+			expectLogicError("push while a push is live", [&]() { signer.startPush(settings, ignore); });
+			push->finish();
+		}
+		expectLogicError("buffer signature in a digest callback", [&]() {
+			signer.sign(data.data(), data.size(), settings, [&](uint64_t, const Digest&) { signer.sign(data.data(), data.size(), settings); });
+		});
+		{
+			// The callback runs on the worker thread, so a write there would wait for the thread itself
+			std::unique_ptr<PushSignature> push;
+			bool isRejected = false;
+			push = signer.startPush(settings, [&](uint64_t, const Digest&) {
+				try
+				{
+					push->write(data.data(), settings.ioBlockSize);
+				}
+				catch (const std::logic_error&)
+				{
+					isRejected = true;
+				}
+			});
+			push->write(data.data(), data.size());
+			push->finish();
+			if (!isRejected)
+			{
+				out << "Signer check 'push in its digest callback' failed: the call is done without an error\n";
+				++failsCount;
+			}
+		}
+		{
+			// A cancelled push passes digests of whole samples only. The rest of the data isn't a digest
+			uint64_t digestsCount = 0;
+			bool hasPartialDigest = false;
+			const size_t wholeSamplesCount = 1;
+			auto push = signer.startPush(settings, [&](uint64_t index, const Digest&) {
+				++digestsCount;
+				hasPartialDigest = hasPartialDigest || index >= wholeSamplesCount;
+			});
+			push->write(data.data(), wholeSamplesCount * settings.sampleSize + settings.sampleSize / 2);
+			push.reset();
+			if (hasPartialDigest || digestsCount > wholeSamplesCount)
+			{
+				out << "Signer check 'cancelled push' failed: a digest of a partial sample is passed\n";
+				++failsCount;
+			}
+		}
+		// The signer is free after rejected calls
+		if (signer.sign(data.data(), data.size(), settings).size() != data.size() / settings.sampleSize)
+		{
+			out << "Signer check 'buffer signature after rejected calls' failed: wrong digests count\n";
+			++failsCount;
+		}
+		return failsCount == 0;
+	}
+
+	// A cost of a per-block debug statement while DEBUG is disabled in the configuration.
+	// Each block passes about ten such statements in the reader, the pool, the queues and the strategy
+	std::vector<BenchmarkResult> runLoggingSuite()
+	{
+		const uint64_t ITERATIONS = 5000000;
+		const size_t blockSize = 64 * 1024;
+		std::vector<BenchmarkResult> results;
+		// The operation is a part of the loop body, so the loop itself is measured too
+		results.push_back(measure("empty loop", ITERATIONS, [](uint64_t i) {
+			volatile uint64_t sink = i;
+			(void)sink;
+		}));
+		results.push_back(measure("LOG(DEBUG), disabled at runtime", ITERATIONS, [blockSize](uint64_t i) {
+			volatile uint64_t sink = i;
+			(void)sink;
+			LOG(DEBUG) << "Pushing block (" << blockSize << "B) in queue. Attempt: " << i;
+		}));
+		// The name is the same for all builds, so a baseline of another build is compared too
+		results.push_back(measure("HOT_LOG(DEBUG)", ITERATIONS, [blockSize](uint64_t i) {
+			volatile uint64_t sink = i;
+			(void)sink;
+			HOT_LOG(DEBUG) << "Pushing block (" << blockSize << "B) in queue. Attempt: " << i;
+		}));
+		results.back().note = HOT_LOG_IS_COMPILED(DEBUG) ? "compiled" : "compiled out";
+		return results;
+	}
+}
+
+int runBenchmarks(const BenchmarkSettings& settings, std::ostream& out)
+{
+	const std::string& suite = settings.suite;
+	const bool isAll = (suite == "all");
+	if (!isAll && suite != "logging" && suite != "queue" && suite != "pool" && suite != "md5" && suite != "conveyer" &&
+		suite != "steady" && suite != "signer")
+	{
+		throw std::invalid_argument("Unknown benchmark suite '" + suite +
+			"'. Expected: logging, queue, pool, md5, conveyer, steady, signer or all");
+	}
+	if (settings.tolerance < 0)
+	{
+		throw std::invalid_argument("Benchmark tolerance should not be negative");
+	}
+	// The baseline is read before runs to fail fast on a wrong file
+	Baseline baseline;
+	if (!settings.baselineFile.empty())
+	{
+		baseline = readBaseline(settings.baselineFile);
+	}
+	ScopedDebugLogsOff debugLogsOff;
+	std::vector<BenchmarkResult> results;
+	if (isAll || suite == "logging")
+	{
+		out << "Hot path logs are compiled from level " << FS_HOT_LOG_MIN_LEVEL
+			<< " (0 - TRACE, 1 - DEBUG, 2 - INFO). Set FS_HOT_LOG_MIN_LEVEL to change it\n";
+		append(results, runLoggingSuite());
+	}
+	if (isAll || suite == "queue")
+	{
+		append(results, runQueueSuite());
+	}
+	if (isAll || suite == "pool")
+	{
+		append(results, runPoolSuite());
+	}
+	if (isAll || suite == "md5")
+	{
+		append(results, runMD5Suite());
+	}
+	if (isAll || suite == "conveyer")
+	{
+		append(results, runConveyerSuite());
+	}
+	if (isAll || suite == "steady")
+	{
+		// The suite is the allocation check only
+		if (isAllocationsCountingEnabled())
+		{
+			append(results, runSteadyStateSuite());
+		}
+		else if (isAll)
+		{
+			out << "The steady suite is skipped: allocations aren't counted by this build. Build with FS_COUNT_ALLOCATIONS\n";
+		}
+		else
+		{
+			throw std::invalid_argument("The steady suite needs allocations counting. Build with FS_COUNT_ALLOCATIONS");
+		}
+	}
+	bool isSignerGuarded = true;
+	if (isAll || suite == "signer")
+	{
+		append(results, runSignerSuite());
+		isSignerGuarded = checkSignerMisuse(out);
+	}
+	printResults(results, out);
+	bool isAllocationFree = true;
+	for (const auto& result : results)
+	{
+		if (result.isAllocationFree && result.allocationsPerOperation > 0)
+		{
+			out << result.name << " allocates " << result.allocationsPerOperation << " times per operation. It should not allocate\n";
+			isAllocationFree = false;
+		}
+		if (result.isAllocationFree && result.poolMissesCount > 0)
+		{
+			out << result.name << " misses pools or doesn't return blocks " << result.poolMissesCount
+				<< " times after the warm up. It should not allocate\n";
+			isAllocationFree = false;
+		}
+	}
+	if (!settings.saveFile.empty())
+	{
+		writeBaseline(settings.saveFile, results);
+		out << "Baseline is saved to " << settings.saveFile << "\n";
+	}
+	if (!settings.baselineFile.empty() && !checkBaseline(baseline, results, settings.tolerance, out))
+	{
+		return -1;
+	}
+	return isAllocationFree && isSignerGuarded ? 0 : -1;
+}
+
+int runHashBenchmark(const HashBenchmarkSettings& settings, std::ostream& out)
+{
+	if (settings.totalBytes == 0 || settings.ioBlockSize == 0 || settings.sampleSize == 0 ||
+		settings.maxBufferSize < settings.ioBlockSize)
+	{
+		throw std::invalid_argument("Hash benchmark needs positive sizes and a buffer not less then an IO block");
+	}
+	struct Kernel
+	{
+		std::string name;
+		size_t tileSize;
+	};
+	std::vector<Kernel> kernels = { { "plain", 0 } };
+	if (settings.tileSize)
+	{
+		kernels.push_back({ "tiled-" + std::to_string(settings.tileSize / 1024) + "KB", settings.tileSize });
+	}
+
+	out << "Hashing " << settings.totalBytes / (1024 * 1024) << " MB per run. Blocks " << settings.ioBlockSize
+		<< " B, digest per " << settings.sampleSize << " B. No disk IO\n";
+	out << std::left << std::setw(10) << "algorithm" << std::setw(14) << "kernel" << std::setw(10) << "data"
+		<< std::right << std::setw(14) << "blocksize" << std::setw(12) << "GB/s" << std::setw(14) << "hash GB/s" << "\n";
+	for (const std::string dataKind : { "random", "zeros", "pattern" })
+	{
+		const BlockT source = makeSyntheticData(dataKind);
+		for (const auto& kernel : kernels)
+		{
+			const auto result = runHashConveyer(settings, source, kernel.tileSize);
+			// GB/s is by the wall time of the conveyer, hash GB/s is by busy time of the strategy only
+			out << std::left << std::setw(10) << "md5" << std::setw(14) << kernel.name << std::setw(10) << dataKind
+				<< std::right << std::setw(14) << settings.sampleSize << std::fixed << std::setprecision(3)
+				<< std::setw(12) << settings.totalBytes / GB / result.wallSeconds
+				<< std::setw(14) << (result.hashBusyNs ? settings.totalBytes / GB / (result.hashBusyNs / 1e9) : 0) << std::endl;
+		}
+	}
+	return 0;
+}
+}
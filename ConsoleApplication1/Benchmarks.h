@@ -0,0 +1,46 @@
+#pragma once
+#include <string>
+#include <ostream>
+#include <cstdint>
+
+namespace transformation_stream
+{
+// Micro-benchmarks of hot paths of the conveyer. They are run by --bench SUITE instead of a signature calculation.
+// Suites:
+//   logging - a disabled LOG(DEBUG) against HOT_LOG(DEBUG)
+//   queue - LockingQueue throughput and handoff latency of one producer and one consumer by block sizes
+//   pool - MemBlocksPool get and push by 1-8 contending threads
+//   md5 - MD5SignatureCalculationStrategy::transform for blocks from 512 B to 64 MB
+//   conveyer - TransformationEngine with the strategy and queues on in-memory data, per IO block
+//   steady - allocations per IO block of the whole conveyer with file IO in its steady state after a warm up.
+//            It fails if it's not 0 or if pools miss or lose blocks after the warm up
+//   signer - repeated in-process signatures of small files by one Signer
+//   all - all of them
+// Allocations per operation are counted only by a build with FS_COUNT_ALLOCATIONS defined (see AllocationCounter.h).
+// Other builds print "-" for them, skip the steady suite in all and refuse it by its name
+struct BenchmarkSettings
+{
+	std::string suite;
+	std::string baselineFile; // Results are compared with this baseline if it's set
+	std::string saveFile; // Results are saved here as a new baseline if it's set
+	double tolerance; // Allowed slowdown against the baseline. 0.25 - 25%
+};
+
+// Runs the suite and checks results by the baseline. A benchmark fails the check if it's slower then the baseline
+// more then by the tolerance or if it makes more heap allocations per operation.
+// Returns the exit code: 0 or -1 if the check is failed. Throws invalid_argument on an unknown suite
+int runBenchmarks(const BenchmarkSettings& settings, std::ostream& out);
+
+struct HashBenchmarkSettings
+{
+	size_t sampleSize; // A portion of data for one digest (--blocksize)
+	size_t ioBlockSize; // Size of blocks in the input queue
+	size_t maxBufferSize; // Bound of the input queue
+	size_t tileSize; // The tile of the tiled kernel
+	uint64_t totalBytes; // Bytes to hash per a run
+};
+
+// Drives transformation strategies through TransformationEngine by synthetic in-memory data (random, zeros,
+// a repeating pattern) without any disk IO. It prints GB/s per algorithm, kernel and data
+int runHashBenchmark(const HashBenchmarkSettings& settings, std::ostream& out);
+}
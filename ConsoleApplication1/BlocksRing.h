@@ -0,0 +1,80 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <utility>
+#include "CommonStreamBuffer.h"
+
+namespace transformation_stream
+{
+// A FIFO of blocks with their push times on a circular array.
+// Unlike a list it doesn't allocate a node per block. The array is doubled when it's full,
+// so a queue allocates only while it reaches its high water count of blocks or its reserve.
+// It isn't thread safe. LockingQueue uses it under its mutex.
+class BlocksRing
+{
+public:
+	struct Entry
+	{
+		BlockPTR block;
+		std::chrono::steady_clock::time_point pushTime;
+	};
+
+	explicit BlocksRing(size_t initialCapacity = 64) : m_entries(std::max<size_t>(initialCapacity, 1)), m_head(0), m_count(0)
+	{
+	}
+
+	bool empty() const { return m_count == 0; }
+
+	size_t size() const { return m_count; }
+
+	void push_back(BlockPTR block, std::chrono::steady_clock::time_point pushTime)
+	{
+		if (m_count == m_entries.size())
+		{
+			grow(2 * m_entries.size());
+		}
+		Entry& entry = m_entries[(m_head + m_count) % m_entries.size()];
+		entry.block = std::move(block);
+		entry.pushTime = pushTime;
+		++m_count;
+	}
+
+	Entry& front()
+	{
+		return m_entries[m_head];
+	}
+
+	// The block of the front entry should be moved out before
+	void pop_front()
+	{
+		m_head = (m_head + 1) % m_entries.size();
+		--m_count;
+	}
+
+	// Pushes of up to capacity blocks don't allocate then
+	void reserve(size_t capacity)
+	{
+		if (capacity > m_entries.size())
+		{
+			grow(capacity);
+		}
+	}
+
+private:
+	void grow(size_t capacity)
+	{
+		std::vector<Entry> entries(capacity);
+		for (size_t i = 0; i < m_count; ++i)
+		{
+			entries[i] = std::move(m_entries[(m_head + i) % m_entries.size()]);
+		}
+		m_entries.swap(entries);
+		m_head = 0;
+	}
+
+	std::vector<Entry> m_entries;
+	size_t m_head;
+	size_t m_count;
+};
+}
@@ -0,0 +1,90 @@
+#include "CallbackSinkQueue.h"
+#include <stdexcept>
+#include "easylogging++.h"
+
+namespace transformation_stream
+{
+CallbackSinkQueue::CallbackSinkQueue(BlockCallback callback, IMemBlocksPool* blocksPool) :
+	m_callback(std::move(callback)),
+	m_blocksPool(blocksPool),
+	m_isStopped(false),
+	m_errno(0)
+{
+	if (!m_callback)
+	{
+		throw std::invalid_argument("A callback of the sink should be set");
+	}
+}
+
+void CallbackSinkQueue::push(BlockPTR block, bool isEndOfStream)
+{
+	if (m_isStopped)
+	{
+		throw std::invalid_argument("the sink's stream is already closed");
+	}
+	if (block)
+	{
+		m_callback(*block);
+		if (m_blocksPool)
+		{
+			m_blocksPool->push(std::move(block));
+		}
+	}
+	if (isEndOfStream)
+	{
+		stopIncomes();
+	}
+}
+
+void CallbackSinkQueue::pushBatch(std::vector<BlockPTR>& blocks, bool isEndOfStream)
+{
+	for (auto& block : blocks)
+	{
+		push(std::move(block), false);
+	}
+	blocks.clear();
+	if (isEndOfStream)
+	{
+		stopIncomes();
+	}
+}
+
+void CallbackSinkQueue::pushError(int inErrno, const std::string& msg)
+{
+	LOG(WARNING) << "Sink: It's come error " << inErrno << " with message: " << msg;
+	if (!m_isStopped)
+	{
+		m_errorMessage = msg;
+		m_errno = inErrno;
+	}
+	stopIncomes();
+}
+
+void CallbackSinkQueue::stopIncomes()
+{
+	m_isStopped = true;
+}
+
+bool CallbackSinkQueue::isInputStopped()
+{
+	return m_isStopped;
+}
+
+BlockPTR CallbackSinkQueue::pop()
+{
+	throw std::logic_error("CallbackSinkQueue is a sink. Blocks can't be popped from it");
+}
+
+size_t CallbackSinkQueue::popBatch(std::vector<BlockPTR>&, size_t, size_t)
+{
+	throw std::logic_error("CallbackSinkQueue is a sink. Blocks can't be popped from it");
+}
+
+void CallbackSinkQueue::throwOnError() const
+{
+	if (m_errno)
+	{
+		throwOnFileError(m_errorMessage, m_errno);
+	}
+}
+}
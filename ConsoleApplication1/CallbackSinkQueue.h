@@ -0,0 +1,45 @@
+#pragma once
+#include <functional>
+#include <atomic>
+#include <string>
+#include "IQueue.h"
+#include "IMemBlocksPool.h"
+
+namespace transformation_stream
+{
+// An output of TransformationEngine which passes each pushed block to a callback instead of a queue.
+// The callback runs synchronously on the pushing thread (the transformation one), so there is no writer thread.
+// Blocks are returned to the pool after the callback. It's a sink only: pops are logic errors.
+class CallbackSinkQueue : public IStreamQueue
+{
+public:
+	using BlockCallback = std::function<void(const BlockT& block)>;
+
+	// blocksPool - blocks are returned here after the callback. They are freed if it's null
+	CallbackSinkQueue(BlockCallback callback, IMemBlocksPool* blocksPool = nullptr);
+
+	void push(BlockPTR block, bool isEndOfStream) override;
+
+	void pushBatch(std::vector<BlockPTR>& blocks, bool isEndOfStream) override;
+
+	void pushError(int inErrno, const std::string& msg) override;
+
+	void stopIncomes() override;
+
+	bool isInputStopped() override;
+
+	BlockPTR pop() override;
+
+	size_t popBatch(std::vector<BlockPTR>& blocks, size_t maxCount, size_t maxBytes) override;
+
+	// Throws runtime_error if an error was pushed
+	void throwOnError() const;
+
+private:
+	const BlockCallback m_callback;
+	IMemBlocksPool* m_blocksPool;
+	std::atomic<bool> m_isStopped;
+	std::atomic<int> m_errno;
+	std::string m_errorMessage;
+};
+}
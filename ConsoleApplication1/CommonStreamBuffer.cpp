@@ -3,6 +3,7 @@
 
 #include <sstream>
 #include <stdexcept>
+#include <cstring>
 #include "easylogging++.h"
 
 namespace transformation_stream
@@ -22,7 +23,7 @@ namespace transformation_stream
 			throw std::runtime_error(errMsg);
 #else
 			stringstream ss;
-			ss << description << file << ". Errno (" << myErrno << "): " << strerror(myErrno);
+			ss << description << ". Errno (" << myErrno << "): " << strerror(myErrno);
 			throw std::runtime_error(ss.str());
 #endif
 		}
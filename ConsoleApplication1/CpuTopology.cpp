@@ -0,0 +1,271 @@
+#include "CpuTopology.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include "easylogging++.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <cerrno>
+#endif
+
+namespace transformation_stream
+{
+#ifndef _WIN32
+namespace
+{
+	// A value of MPOL_PREFERRED from <numaif.h>. It's defined here to avoid a dependency on libnuma
+	const int MEMORY_POLICY_PREFERRED = 1;
+	const size_t MAX_NUMA_NODES = 1024;
+	const std::string CGROUP_ROOT = "/sys/fs/cgroup";
+
+	// Returns the quota in CPUs from cpu.max of the group ("max 100000" or "200000 100000"). 0 if there is no quota
+	double readCgroupQuota(const std::string& groupPath)
+	{
+		std::ifstream cpuMax(CGROUP_ROOT + groupPath + "/cpu.max");
+		std::string quota;
+		double period = 0;
+		if (!(cpuMax >> quota >> period) || quota == "max" || period <= 0)
+		{
+			return 0;
+		}
+		try
+		{
+			return std::stod(quota) / period;
+		}
+		catch (const std::exception&)
+		{
+			return 0;
+		}
+	}
+
+	// The tightest quota among the group of the process and its parents. 0 if there is no quota
+	double getCgroupQuota()
+	{
+		// cgroup v2 has a single line "0::/path" in /proc/self/cgroup
+		std::ifstream cgroupFile("/proc/self/cgroup");
+		std::string line;
+		std::string groupPath;
+		while (std::getline(cgroupFile, line))
+		{
+			if (line.compare(0, 3, "0::") == 0)
+			{
+				groupPath = line.substr(3);
+				break;
+			}
+		}
+		double quota = 0;
+		while (!groupPath.empty())
+		{
+			const double groupQuota = readCgroupQuota(groupPath == "/" ? std::string() : groupPath);
+			if (groupQuota > 0 && (quota == 0 || groupQuota < quota))
+			{
+				quota = groupQuota;
+			}
+			if (groupPath == "/")
+			{
+				break;
+			}
+			const auto slashPos = groupPath.find_last_of('/');
+			groupPath = (slashPos == 0 || slashPos == std::string::npos) ? "/" : groupPath.substr(0, slashPos);
+		}
+		return quota;
+	}
+}
+#endif
+
+CpuBudget getCpuBudget()
+{
+	CpuBudget budget;
+	budget.hardwareThreads = std::thread::hardware_concurrency();
+	budget.affinityCpus = budget.hardwareThreads;
+#ifdef _WIN32
+	DWORD_PTR processMask = 0, systemMask = 0;
+	if (GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask))
+	{
+		size_t count = 0;
+		for (; processMask; processMask &= processMask - 1)
+		{
+			++count;
+		}
+		budget.affinityCpus = count;
+	}
+#else
+	cpu_set_t cpuSet;
+	CPU_ZERO(&cpuSet);
+	if (sched_getaffinity(0, sizeof(cpuSet), &cpuSet) == 0)
+	{
+		budget.affinityCpus = CPU_COUNT(&cpuSet);
+	}
+	budget.quotaCpus = getCgroupQuota();
+#endif
+	size_t effective = budget.affinityCpus;
+	if (budget.quotaCpus > 0)
+	{
+		effective = std::min(effective, static_cast<size_t>(std::ceil(budget.quotaCpus)));
+	}
+	budget.effectiveCpus = std::max<size_t>(effective, 1);
+	return budget;
+}
+
+std::vector<int> parseCpuList(const std::string& cpuList)
+{
+	std::vector<int> cpus;
+	std::stringstream listStream(cpuList);
+	std::string range;
+	while (std::getline(listStream, range, ','))
+	{
+		range.erase(std::remove_if(range.begin(), range.end(), ::isspace), range.end());
+		if (range.empty())
+		{
+			continue;
+		}
+		try
+		{
+			const auto dashPos = range.find('-');
+			const int first = std::stoi(range.substr(0, dashPos));
+			const int last = (dashPos == std::string::npos) ? first : std::stoi(range.substr(dashPos + 1));
+			if (first < 0 || last < first)
+			{
+				throw std::invalid_argument(range);
+			}
+			for (int cpu = first; cpu <= last; ++cpu)
+			{
+				cpus.push_back(cpu);
+			}
+		}
+		catch (const std::exception&)
+		{
+			throw std::invalid_argument("Wrong CPU list '" + cpuList + "'. Expected format is like 0-3,8,10-11");
+		}
+	}
+	std::sort(cpus.begin(), cpus.end());
+	cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+	return cpus;
+}
+
+std::vector<int> getNumaNodeCpus(int numaNode)
+{
+	std::vector<int> cpus;
+#ifdef _WIN32
+	ULONGLONG mask = 0;
+	if (numaNode >= 0 && numaNode <= 0xFF && GetNumaNodeProcessorMask(static_cast<UCHAR>(numaNode), &mask))
+	{
+		for (int cpu = 0; cpu < 64; ++cpu)
+		{
+			if (mask & (1ULL << cpu))
+			{
+				cpus.push_back(cpu);
+			}
+		}
+	}
+#else
+	std::ifstream cpuListFile("/sys/devices/system/node/node" + std::to_string(numaNode) + "/cpulist");
+	std::string cpuList;
+	if (numaNode >= 0 && std::getline(cpuListFile, cpuList))
+	{
+		cpus = parseCpuList(cpuList);
+	}
+#endif
+	if (cpus.empty())
+	{
+		throw std::invalid_argument("NUMA node " + std::to_string(numaNode) + " is unknown or has no CPUs");
+	}
+	return cpus;
+}
+
+ThreadPlacement makeThreadPlacement(const std::string& cpuList, int numaNode)
+{
+	ThreadPlacement placement;
+	placement.numaNode = numaNode;
+	if (!cpuList.empty())
+	{
+		placement.cpus = parseCpuList(cpuList);
+	}
+	if (numaNode >= 0)
+	{
+		const auto nodeCpus = getNumaNodeCpus(numaNode);
+		if (placement.cpus.empty())
+		{
+			placement.cpus = nodeCpus;
+		}
+		else
+		{
+			std::vector<int> localCpus;
+			std::set_intersection(placement.cpus.begin(), placement.cpus.end(),
+				nodeCpus.begin(), nodeCpus.end(), std::back_inserter(localCpus));
+			if (localCpus.empty())
+			{
+				throw std::invalid_argument("There are no CPUs of the list '" + cpuList +
+					"' on NUMA node " + std::to_string(numaNode));
+			}
+			placement.cpus = std::move(localCpus);
+		}
+	}
+	return placement;
+}
+
+void ThreadPlacement::bindCurrentThread(const std::string& threadName) const
+{
+	if (empty())
+	{
+		return;
+	}
+#ifdef _WIN32
+	DWORD_PTR mask = 0;
+	for (auto cpu : cpus)
+	{
+		if (cpu < static_cast<int>(sizeof(mask) * 8))
+		{
+			mask |= (static_cast<DWORD_PTR>(1) << cpu);
+		}
+	}
+	// Windows places pages on the node of the first touching thread, so CPU binding is enough for memory
+	if (mask && !SetThreadAffinityMask(GetCurrentThread(), mask))
+	{
+		LOG(WARNING) << threadName << ": Can't bind thread to CPUs. Error " << GetLastError();
+		return;
+	}
+#else
+	if (!cpus.empty())
+	{
+		cpu_set_t cpuSet;
+		CPU_ZERO(&cpuSet);
+		for (auto cpu : cpus)
+		{
+			if (cpu < CPU_SETSIZE)
+			{
+				CPU_SET(cpu, &cpuSet);
+			}
+		}
+		const int err = pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+		if (err)
+		{
+			LOG(WARNING) << threadName << ": Can't bind thread to CPUs. Errno " << err;
+			return;
+		}
+	}
+	if (numaNode >= 0 && static_cast<size_t>(numaNode) < MAX_NUMA_NODES)
+	{
+		// Pool blocks are first touched by the binded threads. So the preferred policy puts them on the node
+		std::vector<unsigned long> nodeMask(MAX_NUMA_NODES / (8 * sizeof(unsigned long)), 0);
+		nodeMask[numaNode / (8 * sizeof(unsigned long))] |= 1UL << (numaNode % (8 * sizeof(unsigned long)));
+		if (syscall(SYS_set_mempolicy, MEMORY_POLICY_PREFERRED, nodeMask.data(), MAX_NUMA_NODES + 1) != 0)
+		{
+			LOG(WARNING) << threadName << ": Can't set memory policy for NUMA node " << numaNode << ". Errno " << errno;
+		}
+	}
+#endif
+	LOG(INFO) << threadName << ": Thread is binded to " << cpus.size() << " CPUs. NUMA node " << numaNode;
+}
+
+}//end of namespace transformation_stream
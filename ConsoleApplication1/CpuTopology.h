@@ -0,0 +1,46 @@
+#pragma once
+#include <string>
+#include <vector>
+
+namespace transformation_stream
+{
+// A placement of the conveyer threads on CPUs and on a NUMA node.
+// All stages of the conveyer (reader, transformation and writer) share one placement.
+// So blocks of MemBlocksPool are allocated (first touched) and processed on the same node.
+struct ThreadPlacement
+{
+	std::vector<int> cpus; // CPUs allowed for conveyer threads. Empty - no binding
+	int numaNode = -1; // Preferred node for memory allocations. -1 - no preference
+
+	bool empty() const { return cpus.empty() && numaNode < 0; }
+
+	// Bind the calling thread to the placement's CPUs and make the node preferable for its allocations.
+	// It doesn't throw. Failures are logged only, because placement is just an optimization.
+	void bindCurrentThread(const std::string& threadName) const;
+};
+
+// CPU resources which the process is actually allowed to use.
+// Thread counts and pool sizes should be planned by effectiveCpus, not by hardware_concurrency().
+struct CpuBudget
+{
+	size_t hardwareThreads = 0; // std::thread::hardware_concurrency()
+	size_t affinityCpus = 0; // CPUs in the affinity mask of the process
+	double quotaCpus = 0; // cgroup v2 cpu.max quota in CPUs. 0 if the quota is not set
+	size_t effectiveCpus = 1; // min(affinityCpus, quotaCpus rounded up). At least 1
+};
+
+// Detects the CPU budget by the affinity mask and by the cgroup v2 quota of the process and its parent groups
+CpuBudget getCpuBudget();
+
+// Parse a list of CPUs in the format "0-3,8,10-11".
+// Throws invalid_argument on a wrong format
+std::vector<int> parseCpuList(const std::string& cpuList);
+
+// Returns CPUs of the NUMA node. Throws invalid_argument if the node is unknown
+std::vector<int> getNumaNodeCpus(int numaNode);
+
+// Makes a placement from command line settings.
+// If both are set, the CPU list is restricted by CPUs of the node.
+ThreadPlacement makeThreadPlacement(const std::string& cpuList, int numaNode);
+
+}//end of namespace transformation_stream
@@ -1,12 +1,29 @@
 
 #include "Options.h"
 #include "ReadStreamBuffer.h"
+#include "SimulatedReadStream.h"
 #include "WriteSteamBuffer.h"
 #include "MD5SignatureCalculationStrategy.h"
 #include "TransformationEngine.h"
+#include "AdaptiveFusionStrategy.h"
 #include "LockingQueue.h"
 #include "MemBlocksPool.h"
+#include "CpuTopology.h"
+#include "MemoryPressureMonitor.h"
+#include "PipelineStats.h"
+#include "ProgressReporter.h"
+#include "SharedStats.h"
+#include "PipelineTrace.h"
+#include "HardwareCounters.h"
+#include "Benchmarks.h"
+#include "AsyncLogSink.h"
+#include "Sweep.h"
+#include "SignerDaemon.h"
+#include <fstream>
+#include <sstream>
 #include <iostream>
+#include <algorithm>
+#include <cmath>
 //#include <direct.h>
 //#include "logger.h"
 //#include <boost/log/trivial.hpp>
@@ -30,12 +47,63 @@ int main(int argc, const char* argv[])
 		options::UtilityOptions opts;
 		opts.Parse(argc, argv);
 		auto action = opts.GetAction();
-		if (action != options::Action::GetSignature)
+		if (action == options::Action::ShowTop)
+		{
+			return runStatsTop(opts.GetTopName());
+		}
+		if (action == options::Action::RunBenchmarks)
+		{
+			return runBenchmarks({ opts.GetBenchSuite(), opts.GetBenchBaseline(), opts.GetBenchSave(), opts.GetBenchTolerance() }, std::cout);
+		}
+		if (action == options::Action::RunSweep)
+		{
+			const auto& sweepOptions = opts.GetSweepOptions();
+			SweepSettings sweep;
+			sweep.csvFile = sweepOptions.csvFile;
+			sweep.directory = sweepOptions.directory;
+			sweep.fileSizes = parseSizeList(sweepOptions.fileSizes);
+			for (auto size : parseSizeList(sweepOptions.sampleSizes))
+				sweep.sampleSizes.push_back(static_cast<size_t>(size));
+			for (auto size : parseSizeList(sweepOptions.ioBlockSizes))
+				sweep.ioBlockSizes.push_back(static_cast<size_t>(size));
+			for (auto size : parseSizeList(sweepOptions.bufferSizes))
+				sweep.bufferSizes.push_back(static_cast<size_t>(size));
+			std::stringstream backends(sweepOptions.backends);
+			for (std::string backend; std::getline(backends, backend, ','); )
+				sweep.backends.push_back(backend);
+			sweep.isCold = !sweepOptions.isWarm;
+			sweep.repeats = sweepOptions.repeats;
+			return runSweep(sweep, getExecutablePath(argv[0]), std::cout);
+		}
+		if (action != options::Action::GetSignature && action != options::Action::RunHashBenchmark &&
+			action != options::Action::RunDaemon)
 		{
 			opts.ShowHelp();
 		}
 		auto settings = opts.GetSignatureSettings();
 		settings.check(); //throw on inacceptable settings
+		if (action == options::Action::RunHashBenchmark)
+		{
+			return runHashBenchmark({ settings.sampleSize, settings.ioPortionSize, settings.maxBufferSize,
+				settings.hashTileSize, settings.benchBytes }, std::cout);
+		}
+		if (action == options::Action::RunDaemon)
+		{
+			DaemonSettings daemon;
+			daemon.socketPath = settings.daemonSocket;
+			daemon.jobs = settings.daemonJobs;
+			daemon.maxMemory = settings.daemonMemory;
+			daemon.signerSettings.ioBlockSize = settings.ioPortionSize;
+			daemon.signerSettings.maxBufferSize = settings.maxBufferSize;
+			daemon.signerSettings.hashTileSize = settings.hashTileSize;
+			return runDaemon(daemon);
+		}
+		// It's created first, so it writes logs of all destructors of the conveyer
+		std::unique_ptr<AsyncLogSink> asyncLog;
+		if (settings.asyncLog)
+		{
+			asyncLog = std::make_unique<AsyncLogSink>();
+		}
 
 		
 		// It was an idea to read the file by a few big blocks parallel and save their signatures. 
@@ -46,22 +114,168 @@ int main(int argc, const char* argv[])
 		// So as more clear and easiest solution has been made a next solution:
 		// Threads conveyer
 		// Queues for conveyor organization
+		// All threads of the conveyer are binded to one set of CPUs (and one NUMA node if it's set).
+		// Blocks are allocated by the reader thread, so the node's memory is used for them on first touch.
+		// The conveyer is planned by CPUs which the process is allowed to use, not by the host's CPUs count.
+		// In containers a cgroup quota could be much less then hardware_concurrency().
+		// It's taken before the binding, so the affinity is the process's one, not the main thread's one.
+		auto cpuBudget = getCpuBudget();
+		const auto placement = makeThreadPlacement(settings.cpuAffinity, settings.numaNode);
+		placement.bindCurrentThread("Main");
+		if (!placement.cpus.empty())
+		{
+			cpuBudget.effectiveCpus = std::min(cpuBudget.effectiveCpus, placement.cpus.size());
+		}
+		const size_t CONVEYER_THREADS = 3; // reader, transformation and writer
+		LOG(INFO) << "CPU budget: hardware " << cpuBudget.hardwareThreads << ", affinity " << cpuBudget.affinityCpus
+			<< ", cgroup quota " << cpuBudget.quotaCpus << ". Effective CPUs " << cpuBudget.effectiveCpus
+			<< " for " << CONVEYER_THREADS << " conveyer threads";
+		if (cpuBudget.effectiveCpus < CONVEYER_THREADS)
+		{
+			LOG(WARNING) << "Conveyer stages share " << cpuBudget.effectiveCpus << " CPUs. They can't run in parallel";
+		}
 		// Pool makes a good efforts in big files and large ioPortionSize. About 10%
-		MemBlocksPool memPool(settings.maxBufferSize/settings.ioPortionSize + 1);
-		LockingQueue inputQueue(settings.maxBufferSize, "InQueue");
-		LockingQueue outputQueue(settings.maxBufferSize, "OutQueue");
-		// One thread is sequentually reading input file to the inputQueue in an individual thread
-		ReadStream inputStream(settings.source, inputQueue, memPool, settings.ioPortionSize);
-		// Another thread realizes output stream. It writes data from outputQueue to result file backgroundly 
-		WriteStream outputStream(settings.result, outputQueue, settings.ioPortionSize);
+		// Spinning trades CPU for the handoff latency. It makes sense if each conveyer thread has an own CPU
+		// A spinning thread takes the CPU of the thread it waits for, so spinning is limited by parking then
+		auto waitStrategy = parseWaitStrategy(settings.waitStrategy);
+		if (waitStrategy == WaitStrategy::Spin && cpuBudget.effectiveCpus < CONVEYER_THREADS)
+		{
+			waitStrategy = WaitStrategy::SpinThenPark;
+			LOG(WARNING) << "Spin wait strategy with " << cpuBudget.effectiveCpus << " CPUs would slow down the conveyer. "
+				<< toString(waitStrategy) << " is used";
+		}
+		// The engine takes blocks from the input queue by batches of up to a half of the buffer.
+		// So the pool keeps blocks for both the queue and the batch.
+		const size_t batchMaxBytes = settings.maxBufferSize / 2;
+		MemBlocksPool memPool((settings.maxBufferSize + batchMaxBytes)/settings.ioPortionSize + 1);
+		LockingQueue inputQueue(settings.maxBufferSize, "InQueue", waitStrategy);
+		LockingQueue outputQueue(settings.maxBufferSize, "OutQueue", waitStrategy);
+		// Buffers give memory back on memory pressure. The conveyer becomes slower, but the host isn't pushed to reclaim
+		std::unique_ptr<MemoryPressureMonitor> pressureMonitor;
+		if (settings.psiMonitor)
+		{
+			pressureMonitor = std::make_unique<MemoryPressureMonitor>(
+				std::vector<IResizableBuffer*>{ &memPool, &inputQueue, &outputQueue },
+				settings.psiHighThreshold, settings.psiLowThreshold);
+		}
 		// There is a main thread that get chunks of the input file from inputQueue, 
 		// calculates their hashes and write them to the output queue.
-		MD5SignatureCalculationStrategy transformationStrategy(outputQueue, memPool, settings.sampleSize);
-		TransformationEngine engine(inputQueue, outputQueue, transformationStrategy);
+		MD5SignatureCalculationStrategy transformationStrategy(outputQueue, memPool, settings.sampleSize, settings.hashTileSize);
+		// With the stage fusion the reader thread calculates hashes itself while the file comes from the page cache
+		std::unique_ptr<AdaptiveFusionStrategy> fusion;
+		if (settings.fuseStages)
+		{
+			fusion = std::make_unique<AdaptiveFusionStrategy>(transformationStrategy, settings.fusedBlockSize, settings.fuseRatio);
+		}
+		ITransformationStrategy& engineStrategy = fusion ? static_cast<ITransformationStrategy&>(*fusion) : transformationStrategy;
+		if (!settings.traceFile.empty())
+		{
+			// It should be enabled before the conveyer threads start. Each thread keeps the last events only
+			const size_t TRACE_EVENTS_PER_THREAD = 1 << 18;
+			PipelineTrace::enable(TRACE_EVENTS_PER_THREAD);
+			PipelineTrace::setThreadName("TransformationEngine");
+		}
+		if (settings.perfCounters)
+		{
+			HardwareCounters::enable();
+		}
+		// One thread is sequentually reading input file to the inputQueue in an individual thread
+		std::unique_ptr<IReadStream> inputStreamPtr;
+		uint64_t sourceSize = 0;
+		if (settings.simulatedStorage.empty())
+		{
+			inputStreamPtr = std::make_unique<ReadStream>(settings.source, inputQueue, memPool, settings.ioPortionSize, placement, fusion.get());
+			std::ifstream sourceFile(settings.source, std::ios::binary | std::ios::ate);
+			sourceSize = static_cast<uint64_t>(std::max<std::streamoff>(sourceFile.tellg(), 0));
+		}
+		else
+		{
+			// Synthetic data comes with delays of the storage. So buffer sizes could be tried for storages which aren't here
+			auto profile = getStorageProfile(settings.simulatedStorage);
+			if (settings.simulatedLatencyUs >= 0)
+				profile.medianLatencyUs = settings.simulatedLatencyUs;
+			if (settings.simulatedBandwidth > 0)
+				profile.bandwidthMBps = settings.simulatedBandwidth;
+			if (settings.simulatedConcurrency > 0)
+				profile.maxConcurrency = settings.simulatedConcurrency;
+			inputStreamPtr = std::make_unique<SimulatedReadStream>(profile, settings.simulatedSize, inputQueue, memPool,
+				settings.ioPortionSize, placement);
+			sourceSize = settings.simulatedSize;
+		}
+		IReadStream& inputStream = *inputStreamPtr;
+		// Another thread realizes output stream. It writes data from outputQueue to result file backgroundly 
+		// Written digests go back to the strategy's pool. So digests aren't allocated in the steady state
+		WriteStream outputStream(settings.result, outputQueue, settings.ioPortionSize, placement, &transformationStrategy.getDigestPool());
+		TransformationEngine engine(inputQueue, outputQueue, engineStrategy, batchMaxBytes);
+		// Counters of each stage show where the wall time goes
+		PipelineStats stats;
+		stats.add("stages", "read", inputStream.getCounters());
+		stats.add("stages", "hash", transformationStrategy.getCounters());
+		stats.add("stages", "write", outputStream.getCounters());
+		stats.add("queues", "InQueue", inputQueue.getCounters());
+		stats.add("queues", "OutQueue", outputQueue.getCounters());
+		stats.add("pools", "blocks", memPool.getCounters());
+		if (settings.perfCounters)
+		{
+			stats.add("hardware", "read", inputStream.getHardwareCounters());
+			stats.add("hardware", "hash", engine.getHardwareCounters());
+			stats.add("hardware", "write", outputStream.getHardwareCounters());
+		}
+		// Progress is reported by hashed bytes of the file size
+		std::unique_ptr<ProgressReporter> progress;
+		if (settings.progressInterval > 0)
+		{
+			progress = std::make_unique<ProgressReporter>(inputStream.getCounters(), transformationStrategy.getCounters(),
+				sourceSize, std::chrono::milliseconds(static_cast<int64_t>(std::ceil(settings.progressInterval * 1000))),
+				ProgressReporter::parseFormat(settings.progressFormat), std::cerr);
+		}
+		// Monitoring agents read live counters from shared memory without any access to the process
+		std::unique_ptr<SharedStatsPublisher> sharedStats;
+		if (!settings.statsShm.empty())
+		{
+			const SharedStatsSources sources = {
+				{ &inputStream.getCounters(), &transformationStrategy.getCounters(), &outputStream.getCounters() },
+				{ &inputQueue.getCounters(), &outputQueue.getCounters() },
+				&memPool.getCounters(), sourceSize };
+			sharedStats = std::make_unique<SharedStatsPublisher>(settings.statsShm, sources, std::chrono::milliseconds(200));
+		}
 		LOG(INFO) << "Start transformation";
 		engine.transform();
 		LOG(INFO) << "Finish transformation";
+		if (progress)
+		{
+			progress->stop();
+		}
+		if (sharedStats)
+		{
+			sharedStats->stop();
+		}
 		outputStream.waitClose();
+		// Percentiles show stalls which averages hide. Times in queues are logged by the queues
+		LOG(INFO) << "Read latency: " << inputStream.getCounters().latency.toString();
+		LOG(INFO) << "Hash latency: " << transformationStrategy.getCounters().latency.toString();
+		LOG(INFO) << "Write latency: " << outputStream.getCounters().latency.toString();
+		if (outputStream.getCounters().flushes)
+		{
+			LOG(INFO) << "Flush latency: " << outputStream.getCounters().flushLatency.toString();
+		}
+		if (settings.perfCounters)
+		{
+			inputStream.stop();
+			printHardwareCounters({ { "read", &inputStream.getHardwareCounters() },
+				{ "hash", &engine.getHardwareCounters() }, { "write", &outputStream.getHardwareCounters() } }, std::cerr);
+		}
+		if (!settings.statsJson.empty())
+		{
+			stats.writeJsonFile(settings.statsJson);
+			LOG(INFO) << "Statistics are written to " << settings.statsJson;
+		}
+		if (PipelineTrace::isEnabled())
+		{
+			inputStream.stop();
+			PipelineTrace::writeJsonFile(settings.traceFile);
+			LOG(INFO) << "Trace is written to " << settings.traceFile;
+		}
 		LOG(INFO) << "Main destructors run";
 
 	}
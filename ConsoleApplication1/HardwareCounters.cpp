@@ -0,0 +1,194 @@
+#include "HardwareCounters.h"
+
+#include <iomanip>
+#include "easylogging++.h"
+
+#ifndef _WIN32
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+namespace transformation_stream
+{
+namespace
+{
+	const double MB = 1024.0 * 1024.0;
+	std::atomic<bool> g_isEnabled{ false };
+
+#ifndef _WIN32
+	struct EventConfig
+	{
+		uint32_t type;
+		uint64_t config;
+		const char* name;
+	};
+
+	// The order is the same as fields of HardwareCounters
+	const EventConfig EVENTS[] = {
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, "cycles" },
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, "instructions" },
+		{ PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+			(PERF_COUNT_HW_CACHE_RESULT_MISS << 16), "LLC misses" },
+		{ PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+			(PERF_COUNT_HW_CACHE_RESULT_MISS << 16), "dTLB misses" },
+	};
+
+	// Opens a counter of the calling thread on any CPU. Kernel time isn't counted, so waits in queues aren't a part of it
+	int openEvent(const EventConfig& event)
+	{
+		perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = event.type;
+		attr.config = event.config;
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		// Events are counted separately, so the kernel could multiplex them. Times are used to scale the value then
+		attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+		return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0 /*the calling thread*/, -1 /*any CPU*/, -1, 0));
+	}
+
+	// Returns the value scaled by multiplexing
+	uint64_t readEvent(int fd)
+	{
+		uint64_t values[3] = { 0, 0, 0 }; // value, time enabled, time running
+		if (read(fd, values, sizeof(values)) != sizeof(values) || values[2] == 0)
+		{
+			return 0;
+		}
+		return values[1] == values[2] ? values[0] : static_cast<uint64_t>(static_cast<double>(values[0]) * values[1] / values[2]);
+	}
+#endif
+}
+
+double HardwareCounters::getInstructionsPerCycle() const
+{
+	const uint64_t cyclesCount = cycles;
+	return cyclesCount ? static_cast<double>(instructions) / cyclesCount : 0;
+}
+
+double HardwareCounters::getLlcMissesPerMB() const
+{
+	return bytes ? llcMisses / (bytes / MB) : 0;
+}
+
+double HardwareCounters::getDtlbMissesPerMB() const
+{
+	return bytes ? dtlbMisses / (bytes / MB) : 0;
+}
+
+void HardwareCounters::writeJson(std::ostream& out) const
+{
+	out << "{\"cycles\": " << cycles
+		<< ", \"instructions\": " << instructions
+		<< ", \"ipc\": " << getInstructionsPerCycle()
+		<< ", \"llc_misses\": " << llcMisses
+		<< ", \"llc_misses_per_mb\": " << getLlcMissesPerMB()
+		<< ", \"dtlb_misses\": " << dtlbMisses
+		<< ", \"dtlb_misses_per_mb\": " << getDtlbMissesPerMB()
+		<< ", \"bytes\": " << bytes
+		<< ", \"unsupported_events\": " << unsupportedEvents << "}";
+}
+
+void HardwareCounters::enable()
+{
+#ifdef _WIN32
+	LOG(WARNING) << "Hardware performance counters are supported on Linux only";
+#endif
+	g_isEnabled = true;
+}
+
+bool HardwareCounters::isEnabled()
+{
+	return g_isEnabled.load(std::memory_order_relaxed);
+}
+
+ThreadHardwareCounters::ThreadHardwareCounters(HardwareCounters& counters, const char* threadName) :
+	m_counters(counters),
+	m_threadName(threadName),
+	m_bytes(0)
+{
+	for (auto& fd : m_eventFds)
+	{
+		fd = -1;
+	}
+#ifndef _WIN32
+	if (!HardwareCounters::isEnabled())
+	{
+		return;
+	}
+	for (size_t i = 0; i < EVENTS_COUNT; ++i)
+	{
+		m_eventFds[i] = openEvent(EVENTS[i]);
+		if (m_eventFds[i] < 0)
+		{
+			LOG(WARNING) << m_threadName << ": Can't open the performance counter of " << EVENTS[i].name << ". Errno " << errno;
+			addRelaxed(m_counters.unsupportedEvents, 1);
+		}
+	}
+	for (auto fd : m_eventFds)
+	{
+		if (fd >= 0)
+		{
+			ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+			ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+		}
+	}
+#endif
+}
+
+ThreadHardwareCounters::~ThreadHardwareCounters()
+{
+#ifndef _WIN32
+	if (!HardwareCounters::isEnabled())
+	{
+		return;
+	}
+	for (auto fd : m_eventFds)
+	{
+		if (fd >= 0)
+		{
+			ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+		}
+	}
+	std::atomic<uint64_t>* values[EVENTS_COUNT] = { &m_counters.cycles, &m_counters.instructions,
+		&m_counters.llcMisses, &m_counters.dtlbMisses };
+	for (size_t i = 0; i < EVENTS_COUNT; ++i)
+	{
+		if (m_eventFds[i] >= 0)
+		{
+			addRelaxed(*values[i], readEvent(m_eventFds[i]));
+			close(m_eventFds[i]);
+		}
+	}
+	addRelaxed(m_counters.bytes, m_bytes);
+	LOG(INFO) << m_threadName << ": Performance counters: IPC " << m_counters.getInstructionsPerCycle()
+		<< ", LLC misses per MB " << m_counters.getLlcMissesPerMB() << ", dTLB misses per MB " << m_counters.getDtlbMissesPerMB();
+#endif
+}
+
+void printHardwareCounters(const std::vector<std::pair<const char*, const HardwareCounters*>>& stages, std::ostream& out)
+{
+	out << std::left << std::setw(8) << "stage" << std::right << std::setw(16) << "cycles" << std::setw(16) << "instructions"
+		<< std::setw(8) << "IPC" << std::setw(16) << "LLC miss/MB" << std::setw(16) << "dTLB miss/MB" << "\n";
+	for (const auto& stage : stages)
+	{
+		const auto& counters = *stage.second;
+		out << std::left << std::setw(8) << stage.first << std::right << std::setw(16) << counters.cycles
+			<< std::setw(16) << counters.instructions << std::fixed << std::setprecision(2)
+			<< std::setw(8) << counters.getInstructionsPerCycle() << std::setprecision(1)
+			<< std::setw(16) << counters.getLlcMissesPerMB() << std::setw(16) << counters.getDtlbMissesPerMB();
+		if (counters.unsupportedEvents)
+		{
+			out << "  (" << counters.unsupportedEvents << " events are not supported)";
+		}
+		out << "\n";
+	}
+	out << std::flush;
+}
+}
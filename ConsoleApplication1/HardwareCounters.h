@@ -0,0 +1,57 @@
+#pragma once
+#include "PipelineStats.h"
+#include <utility>
+
+namespace transformation_stream
+{
+// CPU performance counters of a conveyer stage: user space cycles, instructions, last level cache and dTLB misses.
+// They are counted by perf_event_open on Linux. It's not supported on other platforms, so counters stay zero there.
+struct HardwareCounters : IStatsCounters
+{
+	std::atomic<uint64_t> cycles{ 0 };
+	std::atomic<uint64_t> instructions{ 0 };
+	std::atomic<uint64_t> llcMisses{ 0 };
+	std::atomic<uint64_t> dtlbMisses{ 0 };
+	std::atomic<uint64_t> bytes{ 0 }; // Bytes processed by the counted threads
+	std::atomic<uint64_t> unsupportedEvents{ 0 }; // Events which the kernel or the CPU doesn't count
+
+	double getInstructionsPerCycle() const;
+
+	// Misses per MB of processed data
+	double getLlcMissesPerMB() const;
+	double getDtlbMissesPerMB() const;
+
+	void writeJson(std::ostream& out) const override;
+
+	// Counting is opt-in. It should be enabled before the conveyer threads start
+	static void enable();
+	static bool isEnabled();
+};
+
+// Counts events of the calling thread from the creation till the destruction and adds them to the stage's counters.
+// It does nothing if counting isn't enabled
+class ThreadHardwareCounters
+{
+public:
+	ThreadHardwareCounters(HardwareCounters& counters, const char* threadName);
+	~ThreadHardwareCounters();
+
+	void setBytes(uint64_t bytes)
+	{
+		m_bytes = bytes;
+	}
+
+	ThreadHardwareCounters(const ThreadHardwareCounters&) = delete;
+	ThreadHardwareCounters& operator=(const ThreadHardwareCounters&) = delete;
+
+private:
+	static constexpr size_t EVENTS_COUNT = 4;
+	HardwareCounters& m_counters;
+	const char* m_threadName;
+	int m_eventFds[EVENTS_COUNT];
+	uint64_t m_bytes;
+};
+
+// Prints a table of IPC and misses per MB of the stages
+void printHardwareCounters(const std::vector<std::pair<const char*, const HardwareCounters*>>& stages, std::ostream& out);
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include "easylogging++.h"
+
+// Severities of hot path logs in the order of easylogging++ levels
+#define FS_LOG_LEVEL_TRACE 0
+#define FS_LOG_LEVEL_DEBUG 1
+#define FS_LOG_LEVEL_INFO 2
+#define FS_LOG_LEVEL_WARNING 3
+#define FS_LOG_LEVEL_ERROR 4
+#define FS_LOG_LEVEL_FATAL 5
+
+// The minimal level of HOT_LOG statements which are compiled at all. It could be set on the command line.
+// Release builds keep INFO and above. Debug builds keep everything and levels are checked at runtime by logger.config
+#ifndef FS_HOT_LOG_MIN_LEVEL
+#	ifdef NDEBUG
+#		define FS_HOT_LOG_MIN_LEVEL FS_LOG_LEVEL_INFO
+#	else
+#		define FS_HOT_LOG_MIN_LEVEL FS_LOG_LEVEL_TRACE
+#	endif
+#endif
+
+// LOG(LEVEL) for code which runs per block: queues, the pool, the reader and transformation strategies.
+// Even a disabled LOG(DEBUG) costs a runtime level check and a writer setup. A statement below the minimal level
+// is a dead branch here, so the compiler removes it with all its arguments.
+// The switch closes the macro's if: "if (x) HOT_LOG(DEBUG) << ...; else ..." keeps the else of the caller's if.
+#define HOT_LOG(LEVEL) switch (0) case 0: default: if (FS_LOG_LEVEL_##LEVEL < FS_HOT_LOG_MIN_LEVEL) {} else LOG(LEVEL)
+
+// It's true if HOT_LOG(LEVEL) statements are compiled
+#define HOT_LOG_IS_COMPILED(LEVEL) (FS_LOG_LEVEL_##LEVEL >= FS_HOT_LOG_MIN_LEVEL)
@@ -10,6 +10,9 @@ struct IStreamQueue
 {
 	virtual void push(BlockPTR, bool isEndOfStream = false) = 0;
 
+	// Push all blocks of the batch with as few synchronizations as possible. The batch is empty after
+	virtual void pushBatch(std::vector<BlockPTR>& blocks, bool isEndOfStream = false) = 0;
+
 	// This method should be a last one of push methods. It assumes stop of stream after
 	virtual void pushError(int inErrno, const std::string& msg) = 0;
 
@@ -19,6 +22,10 @@ struct IStreamQueue
 	virtual bool isInputStopped() = 0;
 
 	virtual BlockPTR pop() = 0;
+
+	// Append to blocks up to maxCount blocks of up to maxBytes in total (but at least one block) by one synchronization.
+	// It waits like pop(). Returns the count of appended blocks. 0 means the end of the stream
+	virtual size_t popBatch(std::vector<BlockPTR>& blocks, size_t maxCount, size_t maxBytes) = 0;
 };
 
 }
\ No newline at end of file
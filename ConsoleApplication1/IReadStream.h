@@ -4,6 +4,8 @@
 
 namespace transformation_stream
 {
+	struct StageCounters;
+	struct HardwareCounters;
 
 	struct IReadStream
 	{
@@ -18,6 +20,12 @@ namespace transformation_stream
 
 		// stop background read of file
 		virtual void stop() = 0;
+
+		// Counters of read blocks. See PipelineStats.h
+		virtual const StageCounters& getCounters() const = 0;
+
+		// CPU events of the read threads. See HardwareCounters.h
+		virtual const HardwareCounters& getHardwareCounters() const = 0;
 	};
 
 };//end of the namespace transformation_stream
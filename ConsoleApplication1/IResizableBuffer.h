@@ -0,0 +1,16 @@
+#pragma once
+#include <cstddef>
+
+namespace transformation_stream
+{
+// A buffer which capacity could be changed at runtime.
+// It's used to give memory back to the system on memory pressure and take it again when pressure clears.
+struct IResizableBuffer
+{
+	virtual ~IResizableBuffer() = default;
+
+	// scale - a part of the configured capacity to use, in (0, 1].
+	// A buffer keeps a minimal capacity which it needs for work, so the real capacity could be larger
+	virtual void setCapacityScale(double scale) = 0;
+};
+}
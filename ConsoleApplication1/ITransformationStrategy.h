@@ -9,5 +9,7 @@ namespace transformation_stream
 		virtual ~ITransformationStrategy() = default;
 		virtual void transform(BlockPTR data) = 0;
 		virtual void dump() = 0;
+		// Pass results accumulated by transform() and dump() to the output
+		virtual void flush() = 0;
 	};
 };//end of the namespace transformation_stream
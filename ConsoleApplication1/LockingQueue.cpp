@@ -1,13 +1,34 @@
 #include "LockingQueue.h"
 #include "easylogging++.h"
+#include "HotLog.h"
+#include "PipelineTrace.h"
+#include "UsdtProbes.h"
+#include <functional>
+#include <sstream>
+#include <algorithm>
+#include <chrono>
+#include <thread>
 
 
 namespace transformation_stream
 {
-LockingQueue::LockingQueue(size_t maxBufferSize, const std::string& queueName) : m_queueName(queueName)
+namespace
+{
+	const auto QUEUE_WAIT_TIMEOUT = chrono::milliseconds(15000);
+	// Bounds of spinning for WaitStrategy::SpinThenPark. Spinning is about microseconds, yielding is a bit longer
+	const size_t SPIN_ITERATIONS = 1024;
+	const size_t YIELD_ITERATIONS = 64;
+	// WaitStrategy::Spin checks the timeout once per this iterations count
+	const size_t SPIN_CLOCK_CHECK_PERIOD = 1024;
+}
+
+LockingQueue::LockingQueue(size_t maxBufferSize, const std::string& queueName, WaitStrategy waitStrategy) :
+																				m_queueName(queueName)
+																				, m_waitStrategy(waitStrategy)
 																				, m_isEOF(false)
 																				, m_errno(0)
-																				, m_maxBufferSize(maxBufferSize)\
+																				, m_maxBufferSize(maxBufferSize)
+																				, m_bufferLimit(maxBufferSize)
 																				, m_QueueBytesSize(0)
 {
 	if (m_maxBufferSize == 0)
@@ -20,8 +41,52 @@ LockingQueue::LockingQueue(size_t maxBufferSize, const std::string& queueName) :
 LockingQueue::~LockingQueue()
 {
 	stopIncomes();
+	LOG(INFO) << m_queueName << ": Wait strategy " << toString(m_waitStrategy)
+		<< ". Waited for space " << m_counters.fullWaitNs / 1000000 << " ms (" << m_counters.fullWaits << " times)"
+		<< ", for data " << m_counters.emptyWaitNs / 1000000 << " ms (" << m_counters.emptyWaits << " times)"
+		<< ". High water " << m_counters.highWaterBytes << " B"
+		<< ". Time in queue " << m_counters.timeInQueue.toString();
+}
 
+template<class Condition>
+bool LockingQueue::spinWait(unique_lock<mutex>& lock, Condition condition)
+{
+	if (m_waitStrategy == WaitStrategy::Block)
+	{
+		return false;
+	}
+	// The condition is checked by atomics, so the lock isn't needed while spinning
+	lock.unlock();
+	if (m_waitStrategy == WaitStrategy::Spin)
+	{
+		const auto spinStart = chrono::steady_clock::now();
+		for (size_t iteration = 1; !condition(); ++iteration)
+		{
+			cpuRelax();
+			if (iteration % SPIN_CLOCK_CHECK_PERIOD == 0 && chrono::steady_clock::now() - spinStart > QUEUE_WAIT_TIMEOUT)
+			{
+				lock.lock();
+				return false;
+			}
+		}
+		return true;
+	}
+	for (size_t iteration = 0; iteration < SPIN_ITERATIONS; ++iteration)
+	{
+		if (condition())
+			return true;
+		cpuRelax();
+	}
+	for (size_t iteration = 0; iteration < YIELD_ITERATIONS; ++iteration)
+	{
+		if (condition())
+			return true;
+		std::this_thread::yield();
+	}
+	lock.lock();
+	return false;
 }
+
 void LockingQueue::push(BlockPTR bufferPtr, bool isEndOfStream)
 {
 	if (!bufferPtr)
@@ -29,22 +94,41 @@ void LockingQueue::push(BlockPTR bufferPtr, bool isEndOfStream)
 		LOG(WARNING) << m_queueName << "empty chunk is come";
 		return;
 	}
+	pushBlocks(&bufferPtr, 1, isEndOfStream);
+}
+
+void LockingQueue::pushBatch(std::vector<BlockPTR>& blocks, bool isEndOfStream)
+{
+	blocks.erase(std::remove(blocks.begin(), blocks.end(), nullptr), blocks.end());
+	if (!blocks.empty())
+	{
+		pushBlocks(blocks.data(), blocks.size(), isEndOfStream);
+	}
+	blocks.clear();
+}
 
-	const auto bufSize = bufferPtr->size();
-	if (bufSize > m_maxBufferSize)
+void LockingQueue::pushBlocks(BlockPTR* blocks, size_t blocksCount, bool isEndOfStream)
+{
+	for (size_t blockIndex = 0; blockIndex < blocksCount; ++blockIndex)
 	{
-		stringstream msg_stream;
-		msg_stream << "Stream error: Attempt to write asynchroniusly chunk of data " <<
-			bufSize << " larger then maximum buffer size (" << m_maxBufferSize << ")";
+		const auto bufSize = blocks[blockIndex]->size();
+		if (bufSize > m_maxBufferSize)
+		{
+			stringstream msg_stream;
+			msg_stream << "Stream error: Attempt to write asynchroniusly chunk of data " <<
+				bufSize << " larger then maximum buffer size (" << m_maxBufferSize << ")";
 
-		LOG(ERROR) << m_queueName << ": " << msg_stream.str();
-		throw invalid_argument(msg_stream.str());
+			LOG(ERROR) << m_queueName << ": " << msg_stream.str();
+			throw invalid_argument(msg_stream.str());
+		}
 	}
 
-	bool isPushed = false;
-	for (size_t attemptsCount = 0; !isPushed && !m_isEOF; ++attemptsCount)
+	TraceSpan traceSpan("push", m_queueName.c_str());
+	size_t pushedCount = 0;
+	for (size_t attemptsCount = 0; pushedCount < blocksCount && !m_isEOF; ++attemptsCount)
 	{
-		LOG(DEBUG) << m_queueName << ":Pushing block (" << bufSize
+		const auto bufSize = blocks[pushedCount]->size();
+		HOT_LOG(DEBUG) << m_queueName << ":Pushing block (" << bufSize
 			<< "B) in queue. Queue size: " << m_QueueBytesSize << "B. Attmpt: " << attemptsCount;
 
 		//It impossibe to make a pushing in queue after any error
@@ -68,30 +152,47 @@ void LockingQueue::push(BlockPTR bufferPtr, bool isEndOfStream)
 		if (!isFreeSpaceEnoughForWrite(bufSize))
 		{
 			// Wait if buffer full
-			if (!m_ReadEventsCV.wait_for(lock, chrono::milliseconds(15000),
-				std::bind(&LockingQueue::needWriteThreadWakeup, this, bufSize)))
+			const auto waitStart = chrono::steady_clock::now();
+			const auto needWakeup = std::bind(&LockingQueue::needWriteThreadWakeup, this, bufSize);
+			if (!spinWait(lock, needWakeup) && !m_ReadEventsCV.wait_for(lock, QUEUE_WAIT_TIMEOUT, needWakeup))
 			{
 				lock.unlock();// An optimization for exclude log output from a locked session
 				LOG(WARNING) << m_queueName << ": Timeout. The queue is full. Still need wait a space for a pushing of " << bufSize << " (B). Buffer size "
 					<< m_QueueBytesSize << ". Attempt" << attemptsCount << ". Is EOF=" << m_isEOF;
 			}
+			addRelaxed(m_counters.fullWaitNs, nanosecondsSince(waitStart));
+			addRelaxed(m_counters.fullWaits, 1);
 			continue;//If thread is waited free space let's try again from start
 		}
 
-		//Add data in the queue
-		m_buffers.push_back(std::move(bufferPtr));
-		m_QueueBytesSize += bufSize;
-		if (isEndOfStream)
+		//Add to the queue all blocks of the batch which fit in it
+		const size_t firstPushed = pushedCount;
+		size_t pushedSize = 0;
+		const auto pushTime = chrono::steady_clock::now();
+		do
+		{
+			const auto blockSize = blocks[pushedCount]->size();
+			m_buffers.push_back(std::move(blocks[pushedCount]), pushTime);
+			m_QueueBytesSize += blockSize;
+			pushedSize += blockSize;
+			++pushedCount;
+		} while (pushedCount < blocksCount && isFreeSpaceEnoughForWrite(blocks[pushedCount]->size()));
+
+		countPushed(pushedCount - firstPushed, pushedSize);
+		if (isEndOfStream && pushedCount == blocksCount)
 		{
 			m_isEOF = isEndOfStream;
 		}
+		const size_t queueBytesSize = m_QueueBytesSize;
 		lock.unlock();// An optimization for exclude log output from a locked session
-		LOG(DEBUG) << m_queueName << ": A new block is add-ed. The size is " << bufSize
+		traceDepth(queueBytesSize);
+		traceSpan.setBytes(pushedSize);
+		FS_PROBE3(queue_push, m_queueName.c_str(), pushedSize, queueBytesSize);
+		HOT_LOG(DEBUG) << m_queueName << ": " << pushedCount - firstPushed << " new blocks are add-ed. The size is " << pushedSize
 			<< " (B). The total queue size is " << m_QueueBytesSize << "B . Attempt "
 			<< attemptsCount << ". Is EOF=" << m_isEOF;
 
 		m_WriteEventsCV.notify_one();
-		isPushed = true;//or break?
 	}
 }
 
@@ -125,42 +226,149 @@ BlockPTR LockingQueue::pop()
 {
 	do
 	{
-		LOG(DEBUG) << m_queueName << ": An attempt to get data from buffer";
+		HOT_LOG(DEBUG) << m_queueName << ": An attempt to get data from buffer";
 		unique_lock<decltype(m_bufferMutex)> lock(m_bufferMutex);
 		if (!m_buffers.empty())
 		{
-			BlockPTR ptr = std::move(m_buffers.front());
+			auto& entry = m_buffers.front();
+			BlockPTR ptr = std::move(entry.block);
 			const auto bufSize = ptr->size();
 			m_QueueBytesSize -= bufSize;
+			m_counters.timeInQueue.record(nanosecondsSince(entry.pushTime));
 			m_buffers.pop_front();
+			const size_t queueBytesSize = m_QueueBytesSize;
 			lock.unlock();
-			LOG(DEBUG) << m_queueName << ": Extracted chunk " << bufSize << " B by user. Buffer size " << m_QueueBytesSize;
+			traceDepth(queueBytesSize);
+			FS_PROBE3(queue_pop, m_queueName.c_str(), bufSize, queueBytesSize);
+			addRelaxed(m_counters.poppedBlocks, 1);
+			addRelaxed(m_counters.poppedBytes, bufSize);
+			HOT_LOG(DEBUG) << m_queueName << ": Extracted chunk " << bufSize << " B by user. Buffer size " << m_QueueBytesSize;
 			m_ReadEventsCV.notify_one();
 			return ptr;
 		}
 		if (m_isEOF)
 		{
-			if (m_errno)
-			{
-				std::string err = m_errnoMsg;
-				LOG(INFO) << m_queueName << ": " << err << "throw errno exception from queue. Errno: " << m_errno;
-				throwOnFileError(err, m_errno);
-			}
+			throwOnStreamError();
 			return BlockPTR(nullptr);
 		}
-		//wait New Data
-		LOG(DEBUG) << m_queueName << ": Wait a new data in queue inside pop(). EOF=" << m_isEOF;
-		if (!m_WriteEventsCV.wait_for(lock, chrono::milliseconds(15000),
-			std::bind(&LockingQueue::needReadThreadWakeup, this)))
+		waitForData(lock);
+	} while (!(m_isEOF && m_QueueBytesSize == 0));
+	return BlockPTR(nullptr);
+}
+
+size_t LockingQueue::popBatch(std::vector<BlockPTR>& blocks, size_t maxCount, size_t maxBytes)
+{
+	TraceSpan traceSpan("pop", m_queueName.c_str());
+	do
+	{
+		HOT_LOG(DEBUG) << m_queueName << ": An attempt to get a batch of data from buffer";
+		unique_lock<decltype(m_bufferMutex)> lock(m_bufferMutex);
+		if (!m_buffers.empty())
+		{
+			// At least one block is extracted even if it's larger then maxBytes
+			size_t count = 0;
+			size_t extractedSize = 0;
+			const auto popTime = chrono::steady_clock::now();
+			do
+			{
+				auto& entry = m_buffers.front();
+				extractedSize += entry.block->size();
+				m_counters.timeInQueue.record(chrono::duration_cast<chrono::nanoseconds>(popTime - entry.pushTime).count());
+				blocks.push_back(std::move(entry.block));
+				m_buffers.pop_front();
+				++count;
+			} while (count < maxCount && !m_buffers.empty() && extractedSize + m_buffers.front().block->size() <= maxBytes);
+			m_QueueBytesSize -= extractedSize;
+			const size_t queueBytesSize = m_QueueBytesSize;
+			lock.unlock();
+			traceDepth(queueBytesSize);
+			traceSpan.setBytes(extractedSize);
+			FS_PROBE3(queue_pop, m_queueName.c_str(), extractedSize, queueBytesSize);
+			addRelaxed(m_counters.poppedBlocks, count);
+			addRelaxed(m_counters.poppedBytes, extractedSize);
+			HOT_LOG(DEBUG) << m_queueName << ": Extracted " << count << " chunks of " << extractedSize
+				<< " B by user. Buffer size " << m_QueueBytesSize;
+			m_ReadEventsCV.notify_one();
+			return count;
+		}
+		if (m_isEOF)
 		{
-			LOG(WARNING) << m_queueName << ": Timeout on background write waiting. Buffers " << m_QueueBytesSize;
+			throwOnStreamError();
+			return 0;
 		}
-		lock.unlock();
-		LOG(DEBUG) << m_queueName << ": Stop waiting of new data in queue";
+		waitForData(lock);
 	} while (!(m_isEOF && m_QueueBytesSize == 0));
-	return BlockPTR(nullptr);
+	return 0;
+}
+
+void LockingQueue::countPushed(size_t blocksCount, size_t bytes)
+{
+	addRelaxed(m_counters.pushedBlocks, blocksCount);
+	addRelaxed(m_counters.pushedBytes, bytes);
+	// Only pushers change the high water marks and they do it under the lock
+	if (m_QueueBytesSize > m_counters.highWaterBytes.load(std::memory_order_relaxed))
+	{
+		m_counters.highWaterBytes.store(m_QueueBytesSize, std::memory_order_relaxed);
+	}
+	if (m_buffers.size() > m_counters.highWaterBlocks.load(std::memory_order_relaxed))
+	{
+		m_counters.highWaterBlocks.store(m_buffers.size(), std::memory_order_relaxed);
+	}
+}
+
+void LockingQueue::traceDepth(size_t queueBytesSize)
+{
+	if (PipelineTrace::isEnabled())
+	{
+		PipelineTrace::addCounter(m_queueName.c_str(), queueBytesSize);
+	}
 }
 
+void LockingQueue::throwOnStreamError()
+{
+	if (m_errno)
+	{
+		std::string err = m_errnoMsg;
+		LOG(INFO) << m_queueName << ": " << err << "throw errno exception from queue. Errno: " << m_errno;
+		throwOnFileError(err, m_errno);
+	}
+}
+
+void LockingQueue::waitForData(unique_lock<mutex>& lock)
+{
+	//wait New Data
+	HOT_LOG(DEBUG) << m_queueName << ": Wait a new data in queue inside pop(). EOF=" << m_isEOF;
+	const auto waitStart = chrono::steady_clock::now();
+	const auto needWakeup = std::bind(&LockingQueue::needReadThreadWakeup, this);
+	if (!spinWait(lock, needWakeup) && !m_WriteEventsCV.wait_for(lock, QUEUE_WAIT_TIMEOUT, needWakeup))
+	{
+		LOG(WARNING) << m_queueName << ": Timeout on background write waiting. Buffers " << m_QueueBytesSize;
+	}
+	if (lock.owns_lock())
+	{
+		lock.unlock();
+	}
+	addRelaxed(m_counters.emptyWaitNs, nanosecondsSince(waitStart));
+	addRelaxed(m_counters.emptyWaits, 1);
+	HOT_LOG(DEBUG) << m_queueName << ": Stop waiting of new data in queue";
+}
+
+void LockingQueue::setCapacityScale(double scale)
+{
+	{
+		// Change the bound under the mutex to not miss a wakeup of a waiting pusher
+		lock_guard<decltype(m_bufferMutex)> lock(m_bufferMutex);
+		m_bufferLimit = std::min(static_cast<size_t>(m_maxBufferSize * scale), m_maxBufferSize);
+	}
+	m_ReadEventsCV.notify_all();
+	LOG(INFO) << m_queueName << ": Queue bound is set to " << m_bufferLimit << "B of " << m_maxBufferSize << "B";
+}
+
+void LockingQueue::reserve(size_t blocksCount)
+{
+	lock_guard<decltype(m_bufferMutex)> lock(m_bufferMutex);
+	m_buffers.reserve(blocksCount);
+}
 
 bool LockingQueue::needReadThreadWakeup()
 {
@@ -169,7 +377,9 @@ bool LockingQueue::needReadThreadWakeup()
 
 bool LockingQueue::isFreeSpaceEnoughForWrite(size_t dataSize)
 {
-	return static_cast<int64_t>(dataSize) <= static_cast<int64_t>(m_maxBufferSize - m_QueueBytesSize);
+	// The empty queue takes any block up to m_maxBufferSize even if the bound is decreased now
+	return m_QueueBytesSize == 0 ||
+		static_cast<int64_t>(dataSize) <= static_cast<int64_t>(m_bufferLimit) - static_cast<int64_t>(m_QueueBytesSize);
 }
 
 bool LockingQueue::needWriteThreadWakeup(size_t dataSize)
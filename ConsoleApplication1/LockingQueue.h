@@ -3,27 +3,35 @@
 #include "CommonStreamBuffer.h"
 
 using namespace std;
-#include <list>
+#include <chrono>
 #include <mutex>
+#include <condition_variable>
 #include <atomic>
 #include <utility>
 #include "IQueue.h"
+#include "IResizableBuffer.h"
+#include "WaitStrategy.h"
+#include "PipelineStats.h"
+#include "BlocksRing.h"
 
 namespace transformation_stream
 {
 // It's an implementation of IStreamQueue with
 // - queue size bounds (by size in bytes)
-// - active waiting on push and pop operations if the queue is full
+// - active waiting on push and pop operations if the queue is full (by a configurable wait strategy)
+// - the size bound could be decreased at runtime on memory pressure
 
-class LockingQueue : public IStreamQueue
+class LockingQueue : public IStreamQueue, public IResizableBuffer
 {
 public:
-	LockingQueue(size_t maxBufferSize, const std::string& queueName);
+	LockingQueue(size_t maxBufferSize, const std::string& queueName, WaitStrategy waitStrategy = WaitStrategy::Block);
 
 	virtual ~LockingQueue();
 
 	void push(BlockPTR bufferPtr, bool isEndOfStream) override;
 
+	void pushBatch(std::vector<BlockPTR>& blocks, bool isEndOfStream) override;
+
 	void pushError(int inErrno, const std::string& msgDetails) override;
 
 	void stopIncomes() override;
@@ -32,24 +40,56 @@ public:
 
 	BlockPTR pop() override;
 
+	size_t popBatch(std::vector<BlockPTR>& blocks, size_t maxCount, size_t maxBytes) override;
+
+	// A block larger then the decreased bound is still pushed to the empty queue. So a push doesn't wait forever.
+	void setCapacityScale(double scale) override;
+
+	// Slots for blocksCount blocks are allocated now, so pushes don't allocate till the queue has more blocks
+	void reserve(size_t blocksCount);
+
+	const QueueCounters& getCounters() const { return m_counters; }
+
 private:
+	// Spins without the lock while the condition is false, by the wait strategy.
+	// Returns true (the lock is released) if the condition became true.
+	// Returns false (the lock is taken) if the caller should park on a condition variable
+	template<class Condition>
+	bool spinWait(unique_lock<mutex>& lock, Condition condition);
+
+	// Pushes blocks in order. Each lock acquisition takes as many blocks as fit in the queue
+	void pushBlocks(BlockPTR* blocks, size_t blocksCount, bool isEndOfStream);
+
+	// Waits by the wait strategy until data or EOF come. The lock is released after
+	void waitForData(unique_lock<mutex>& lock);
+
+	void throwOnStreamError();
+
+	// Updates counters of pushes. It's called under the lock
+	void countPushed(size_t blocksCount, size_t bytes);
+
+	// Records the queue depth to the trace if it's enabled
+	void traceDepth(size_t queueBytesSize);
+
 	bool needReadThreadWakeup();
 
 	bool isFreeSpaceEnoughForWrite(size_t dataSize);
 
 	bool needWriteThreadWakeup(size_t dataSize);
 
-	const std::string m_queueName; // Just for logs
+	const std::string m_queueName; // Just for logs and traces
+	const WaitStrategy m_waitStrategy;
 	atomic<bool> m_isEOF;
 	atomic<int> m_errno; // Not 0 if an error is occured
 	std::string m_errnoMsg;
 
-	const size_t m_maxBufferSize;//in bytes.
+	const size_t m_maxBufferSize;//in bytes. Configured bound
+	std::atomic<size_t> m_bufferLimit;//in bytes. Current bound. It's less then m_maxBufferSize on memory pressure
 	std::atomic<size_t> m_QueueBytesSize;//in bytes. Atomic because in some cases uses without mutex. It's a bit faster
 
 
-	// buffer with prepared chunks for user
-	ListOfBlocks m_buffers;
+	// buffer with prepared chunks for user. Push times are for the time in queue histogram
+	BlocksRing m_buffers;
 	mutex m_bufferMutex;
 
 	//Events of read from buffer
@@ -58,6 +98,8 @@ private:
 	//Events of background write to buffer from file
 	condition_variable m_WriteEventsCV;
 
+	QueueCounters m_counters;
+
 };
 
 }// end of namespace
\ No newline at end of file
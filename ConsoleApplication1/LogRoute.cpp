@@ -0,0 +1,101 @@
+#include "LogRoute.h"
+
+#include <mutex>
+#include "easylogging++.h"
+
+namespace transformation_stream
+{
+namespace
+{
+	const char* const DEFAULT_CALLBACK_ID = "DefaultLogDispatchCallback";
+
+	thread_local const LogCallback* t_route = nullptr; // null - lines of the thread aren't routed
+	std::once_flag g_routedDispatchOnce;
+
+	LogLevel toLogLevel(el::Level level)
+	{
+		switch (level)
+		{
+		case el::Level::Trace: return LogLevel::Trace;
+		case el::Level::Info: return LogLevel::Info;
+		case el::Level::Warning: return LogLevel::Warning;
+		case el::Level::Error: return LogLevel::Error;
+		case el::Level::Fatal: return LogLevel::Fatal;
+		default: return LogLevel::Debug; // Debug and verbose
+		}
+	}
+
+	// The default dispatch for threads without a route
+	class RoutedLogDispatchCallback : public el::base::DefaultLogDispatchCallback
+	{
+	protected:
+		void handle(const el::LogDispatchData* data) override
+		{
+			if (!routeLogLine(data))
+			{
+				el::base::DefaultLogDispatchCallback::handle(data);
+			}
+		}
+	};
+
+	// The default dispatch could be replaced already (see AsyncLogSink). Then the replacement routes lines itself
+	void replaceDefaultLogDispatch()
+	{
+		std::lock_guard<el::base::threading::Mutex> lock(ELPP->lock());
+		if (el::Helpers::logDispatchCallback<el::base::DefaultLogDispatchCallback>(DEFAULT_CALLBACK_ID))
+		{
+			el::Helpers::uninstallLogDispatchCallback<el::base::DefaultLogDispatchCallback>(DEFAULT_CALLBACK_ID);
+			el::Helpers::installLogDispatchCallback<RoutedLogDispatchCallback>(DEFAULT_CALLBACK_ID);
+		}
+	}
+}
+
+ScopedLogRoute::ScopedLogRoute(const LogCallback& callback) :
+	ScopedLogRoute(&callback)
+{
+}
+
+ScopedLogRoute::ScopedLogRoute(const LogCallback* callback) :
+	m_previous(t_route)
+{
+	if (callback)
+	{
+		std::call_once(g_routedDispatchOnce, replaceDefaultLogDispatch);
+	}
+	t_route = callback;
+}
+
+ScopedLogRoute::~ScopedLogRoute()
+{
+	t_route = m_previous;
+}
+
+bool routeLogLine(const el::LogDispatchData* data)
+{
+	const LogCallback* route = t_route;
+	if (!route)
+	{
+		return false;
+	}
+	if (*route)
+	{
+		// Lines of the callback itself go to the default outputs
+		t_route = nullptr;
+		try
+		{
+			(*route)(toLogLevel(data->logMessage()->level()), data->logMessage()->message());
+		}
+		catch (...)
+		{
+		}
+		t_route = route;
+	}
+	return true;
+}
+
+void installDefaultLogDispatch()
+{
+	std::lock_guard<el::base::threading::Mutex> lock(ELPP->lock());
+	el::Helpers::installLogDispatchCallback<RoutedLogDispatchCallback>(DEFAULT_CALLBACK_ID);
+}
+}
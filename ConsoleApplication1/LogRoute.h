@@ -0,0 +1,57 @@
+#pragma once
+#include <functional>
+#include <string>
+
+namespace el
+{
+class LogDispatchData;
+}
+
+namespace transformation_stream
+{
+enum class LogLevel
+{
+	Trace,
+	Debug,
+	Info,
+	Warning,
+	Error,
+	Fatal
+};
+
+// A receiver of log lines. It's called under the lock of easylogging++, so it shouldn't log by LOG itself
+// (such lines are not routed back, but they are mixed with the routed one). Exceptions of it are ignored
+using LogCallback = std::function<void(LogLevel level, const std::string& message)>;
+
+// Lines of easylogging++ (LOG, HOT_LOG) of the current thread go to the callback instead of files and the console
+// while the route lives. An empty callback drops them. Routes are nested: the previous one is back on the destruction.
+// Signer routes lines of its threads, so a host of the library gets diagnostics of the conveyer by its callback only.
+// The library doesn't define the storage of easylogging++ and doesn't build easylogging++.cc: the host links them once
+// (INITIALIZE_EASYLOGGINGPP), like FileSignature does. A host which logs by easylogging++ itself keeps its own ones.
+// The first route replaces the default dispatch of the process by a routing one. Lines of threads without a route
+// go to the default outputs as before
+class ScopedLogRoute
+{
+public:
+	explicit ScopedLogRoute(const LogCallback& callback);
+
+	// Null - lines go to the default outputs, like on a thread without routes. Signer calls digest callbacks so:
+	// logs of the host's callback are the host's ones
+	explicit ScopedLogRoute(const LogCallback* callback);
+	~ScopedLogRoute();
+
+	ScopedLogRoute(const ScopedLogRoute&) = delete;
+	ScopedLogRoute& operator=(const ScopedLogRoute&) = delete;
+
+private:
+	const LogCallback* const m_previous;
+};
+
+// Passes the line to the route of the current thread. Returns false if the thread has no route.
+// Dispatch callbacks of easylogging++ call it first
+bool routeLogLine(const el::LogDispatchData* data);
+
+// Installs the default dispatch of easylogging++ which keeps routes. A dispatch which has replaced
+// the default one (see AsyncLogSink) restores it by this
+void installDefaultLogDispatch();
+}
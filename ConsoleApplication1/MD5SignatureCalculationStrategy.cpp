@@ -1,19 +1,50 @@
 #include "MD5SignatureCalculationStrategy.h"
 #include "MemBlocksPool.h"
 #include <boost/algorithm/hex.hpp>
+#include <algorithm>
 #include "easylogging++.h"
+#include "HotLog.h"
+#include "PipelineTrace.h"
+#include "UsdtProbes.h"
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <xmmintrin.h>
+#endif
 
 namespace transformation_stream
 {
+namespace
+{
+	// Pending digests are pushed to the output queue not later then this count is reached
+	const size_t MAX_PENDING_DIGESTS = 64;
+	// The next tile is prefetched by steps of this size while the current tile is hashed by the same steps
+	const size_t PREFETCH_STEP = 4 * 1024;
+	const size_t CACHE_LINE_SIZE = 64;
+
+	inline void prefetchRange(const char_type* data, size_t size)
+	{
+		for (size_t offset = 0; offset < size; offset += CACHE_LINE_SIZE)
+		{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+			_mm_prefetch(reinterpret_cast<const char*>(data + offset), _MM_HINT_T0);
+#elif defined(__GNUC__)
+			__builtin_prefetch(data + offset, 0 /*read*/, 3 /*keep in all cache levels*/);
+#endif
+		}
+	}
+}
 
-MD5SignatureCalculationStrategy::MD5SignatureCalculationStrategy(IStreamQueue& out, MemBlocksPool& memPool, size_t portion_size) :
+MD5SignatureCalculationStrategy::MD5SignatureCalculationStrategy(IStreamQueue& out, MemBlocksPool& memPool, size_t portion_size,
+	size_t tile_size, IMemBlocksPool* digestPool) :
 	m_out(out),
 	m_memPool(memPool),
 	m_portionSize(portion_size),
+	m_tileSize(tile_size),
 	m_transformedCount(0),
-	m_blockWritten(0)
+	m_blockWritten(0),
+	m_ownDigestPool(MAX_POOLED_DIGESTS),
+	m_digestPool(digestPool ? *digestPool : m_ownDigestPool)
 {
-	m_md5 = make_unique<boost::uuids::detail::md5>();
+	m_pendingDigests.reserve(MAX_PENDING_DIGESTS);
 }
 
 void MD5SignatureCalculationStrategy::transform(BlockPTR data)
@@ -22,13 +53,20 @@ void MD5SignatureCalculationStrategy::transform(BlockPTR data)
 	if (!data)
 		return;
 
-	LOG(DEBUG) << "Start transform chunk of data size " << data->size();
+	transformBytes(data->empty() ? nullptr : &((*data)[0]), data->size());
+	m_memPool.push(std::move(data));
+}
+
+void MD5SignatureCalculationStrategy::transformBytes(const char_type* data, size_t blockSize)
+{
+	HOT_LOG(DEBUG) << "Start transform chunk of data size " << blockSize;
+	const auto transformStart = std::chrono::steady_clock::now();
  	size_t dataShift = 0;
-	for (auto dataSize = data->size(); dataSize > 0;)
+	for (auto dataSize = blockSize; dataSize > 0;)
 	{
 		if (dataSize < m_portionSize - m_transformedCount)
 		{
-			m_md5->process_bytes(&((*data)[0]) + dataShift, dataSize);
+			processBytes(data + dataShift, dataSize);
 			dataShift += dataSize;
 			m_transformedCount += dataSize;
 			dataSize = 0;
@@ -37,10 +75,10 @@ void MD5SignatureCalculationStrategy::transform(BlockPTR data)
 
 		// Buffer is larger or equal then block for hash
 		// Fullfill block for hash calculation
-		LOG(DEBUG) << "Fullfill block for hash calculation size " << m_portionSize - m_transformedCount << 
+		HOT_LOG(DEBUG) << "Fullfill block for hash calculation size " << m_portionSize - m_transformedCount << 
 			", dataShift " << dataShift;
-		m_md5->process_bytes(&((*data)[0]) + dataShift, m_portionSize - m_transformedCount);
-		LOG(DEBUG) << "Hash calculation finished.";
+		processBytes(data + dataShift, m_portionSize - m_transformedCount);
+		HOT_LOG(DEBUG) << "Hash calculation finished.";
 
 		// Shift buffer
 		dataSize -= m_portionSize - m_transformedCount;
@@ -48,16 +86,47 @@ void MD5SignatureCalculationStrategy::transform(BlockPTR data)
 		m_transformedCount += m_portionSize - m_transformedCount;
 
 		// Put hash in file
-		LOG(DEBUG) << "get hash bytes";
+		HOT_LOG(DEBUG) << "get hash bytes";
 		dump();
 
-		LOG(DEBUG) << "create new hash";
-		// Create new MD5 for calculation
-		m_md5 = make_unique<boost::uuids::detail::md5>();
+		HOT_LOG(DEBUG) << "create new hash";
+		// Reset MD5 for calculation
+		m_md5 = boost::uuids::detail::md5();
 		m_transformedCount = 0;//reset calculation state
-		LOG(DEBUG) << "Hash calculation is finished";
+		HOT_LOG(DEBUG) << "Hash calculation is finished";
+	}
+	const uint64_t transformNs = nanosecondsSince(transformStart);
+	m_counters.addBlock(blockSize, transformNs);
+	FS_PROBE2(hash_done, blockSize, transformNs);
+	if (PipelineTrace::isEnabled())
+	{
+		PipelineTrace::addSpan("hash", "MD5", transformStart, transformNs, blockSize);
+	}
+}
+
+void MD5SignatureCalculationStrategy::processBytes(const char_type* data, size_t size)
+{
+	if (m_tileSize == 0 || size <= m_tileSize)
+	{
+		m_md5.process_bytes(data, size);
+		return;
+	}
+	// A large block doesn't fit in L2 and would be streamed from L3 or memory.
+	// So it's hashed by tiles, and each step of a tile prefetches the same step of the next tile
+	for (size_t tileShift = 0; tileShift < size; tileShift += m_tileSize)
+	{
+		const size_t tileSize = std::min(m_tileSize, size - tileShift);
+		const size_t nextTileShift = tileShift + tileSize;
+		const size_t nextTileSize = std::min(m_tileSize, size - nextTileShift);
+		for (size_t stepShift = 0; stepShift < tileSize; stepShift += PREFETCH_STEP)
+		{
+			if (stepShift < nextTileSize)
+			{
+				prefetchRange(data + nextTileShift + stepShift, std::min(PREFETCH_STEP, nextTileSize - stepShift));
+			}
+			m_md5.process_bytes(data + tileShift + stepShift, std::min(PREFETCH_STEP, tileSize - stepShift));
+		}
 	}
-	m_memPool.push(std::move(data));
 }
 
 void MD5SignatureCalculationStrategy::dump()
@@ -70,15 +139,29 @@ void MD5SignatureCalculationStrategy::dump()
 		LOG(INFO) << "Dump MD5 portion of size " << m_transformedCount << " less then " << m_portionSize;
 	}
 	boost::uuids::detail::md5::digest_type digest;
-	m_md5->get_digest(digest);
+	m_md5.get_digest(digest);
 	uint8_t* tmpBufferPtr = reinterpret_cast<uint8_t*>(&(digest[0]));
 	const size_t MD5BytesSize = 16; //sizeof(digest)
-	BlockPTR buffer = make_unique<BlockT>(tmpBufferPtr, tmpBufferPtr + MD5BytesSize);
+	BlockPTR buffer = m_digestPool.get(MD5BytesSize);
+	std::copy(tmpBufferPtr, tmpBufferPtr + MD5BytesSize, buffer->begin());
 	//std::string md5Text;
 	//boost::algorithm::hex(buffer->begin(), buffer->end(), back_inserter(md5Text));
 	//LOG(TRACE) << "New md5: " << md5Text;
-	m_out.push(std::move(buffer));
+	m_pendingDigests.push_back(std::move(buffer));
+	FS_PROBE1(digest_ready, m_blockWritten);
 	m_blockWritten++;
+	if (m_pendingDigests.size() >= MAX_PENDING_DIGESTS)
+	{
+		flush();
+	}
+}
+
+void MD5SignatureCalculationStrategy::flush()
+{
+	if (!m_pendingDigests.empty())
+	{
+		m_out.pushBatch(m_pendingDigests);
+	}
 }
 
 };//end of the namespace transformation_stream
\ No newline at end of file
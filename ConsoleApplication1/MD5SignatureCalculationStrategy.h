@@ -7,25 +7,54 @@
 #include "IQueue.h"
 #include "MemBlocksPool.h"
 #include "ITransformationStrategy.h"
+#include "PipelineStats.h"
 
 namespace transformation_stream
 {
 //Class implements logic of MD5 signature file build
 struct MD5SignatureCalculationStrategy: ITransformationStrategy
 {
-	MD5SignatureCalculationStrategy(IStreamQueue& out, MemBlocksPool& memPool, size_t portion_size);
+	// tile_size - data is hashed by tiles of this size with a prefetch of the next tile. 0 - no tiling
+	// digestPool - a pool of digest blocks shared by strategies of a few runs. The strategy's own pool is used if it's null
+	MD5SignatureCalculationStrategy(IStreamQueue& out, MemBlocksPool& memPool, size_t portion_size,
+		size_t tile_size = DEFAULT_TILE_SIZE, IMemBlocksPool* digestPool = nullptr);
+
+	static constexpr size_t DEFAULT_TILE_SIZE = 64 * 1024;
 
 	void transform(BlockPTR data) override;
 
+	// Hash data which the strategy doesn't own, like transform() does with a block. There is no copy of the data
+	void transformBytes(const char_type* data, size_t size);
+
 	void dump() override;
 
+	void flush() override;
+
+	const StageCounters& getCounters() const { return m_counters; }
+
+	// Digest blocks are taken from this pool. A writer should return written digests here,
+	// so the steady state of the conveyer doesn't allocate per digest
+	IMemBlocksPool& getDigestPool() { return m_digestPool; }
+
+	// Digests pooled for reuse at most. It's about a few MB of small blocks
+	static constexpr size_t MAX_POOLED_DIGESTS = 64 * 1024;
+
 private:
+	// Hash the data by L2-sized tiles. The next tile is prefetched while the current one is hashed
+	void processBytes(const char_type* data, size_t size);
+
 	IStreamQueue& m_out;
 	MemBlocksPool& m_memPool;
 	const size_t m_portionSize;
+	const size_t m_tileSize;
 	size_t m_transformedCount;
-	std::unique_ptr<boost::uuids::detail::md5> m_md5;
+	boost::uuids::detail::md5 m_md5; // It's reset by an assignment for each sample block
 	size_t m_blockWritten;
+	// Digests are pushed to the output by batches. It saves synchronizations on small sample blocks
+	std::vector<BlockPTR> m_pendingDigests;
+	MemBlocksPool m_ownDigestPool;
+	IMemBlocksPool& m_digestPool;
+	StageCounters m_counters;
 
 };
 
@@ -1,37 +1,45 @@
 #pragma once
-#include <queue>
+#include <vector>
 #include <mutex>
 #include<memory>
 #include "easylogging++.h"
+#include "HotLog.h"
 #include "CommonStreamBuffer.h"
 #include "IMemBlocksPool.h"
+#include "IResizableBuffer.h"
+#include "PipelineStats.h"
 
 namespace transformation_stream
 {
-struct MemBlocksPool: IMemBlocksPool
+struct MemBlocksPool: IMemBlocksPool, IResizableBuffer
 {
-	MemBlocksPool(size_t maxItemsCount):m_maxItemsCount(maxItemsCount)
+	MemBlocksPool(size_t maxItemsCount):m_configuredItemsCount(maxItemsCount), m_maxItemsCount(maxItemsCount)
 	{
 	}
 
 	BlockPTR get(size_t size) override
 	{
+		addRelaxed(m_counters.gets, 1);
 		unique_lock<decltype(m_mutex)> lock(m_mutex);
 		if (!m_blocks.empty())
 		{
-			BlockPTR ptr = std::move(m_blocks.front());
-			m_blocks.pop();
+			BlockPTR ptr = std::move(m_blocks.back());
+			m_blocks.pop_back();
 			lock.unlock();
+			addRelaxed(m_counters.hits, 1);
 			if (ptr->size() != size)
 			{
-				LOG(DEBUG) << "Resizing from " << ptr->size() << " to " << size;
+				addRelaxed(m_counters.resizes, 1);
+				HOT_LOG(DEBUG) << "Resizing from " << ptr->size() << " to " << size;
 				// it's a really rare case in our code 
 				ptr->resize(size);
 			}
 			return ptr;
 		}
+		// The capacity is changed under the mutex, so it's copied before the unlock
+		const size_t maxItemsCount = m_maxItemsCount;
 		lock.unlock();
-		LOG(DEBUG) << "No data in pool. MaxSize " << m_maxItemsCount;
+		HOT_LOG(DEBUG) << "No data in pool. MaxSize " << maxItemsCount;
 		return make_unique<BlockT>(size);
 
 
@@ -41,20 +49,58 @@ struct MemBlocksPool: IMemBlocksPool
 		if (!block)
 			return;
 
+		addRelaxed(m_counters.returns, 1);
 		unique_lock<decltype(m_mutex)> lock(m_mutex);
 		if (m_blocks.size() < m_maxItemsCount)
 		{
-			m_blocks.push(std::move(block));
+			m_blocks.push_back(std::move(block));
 		}
 		else
 		{
-			LOG(DEBUG) << "Remove buffer block";
+			lock.unlock();
+			addRelaxed(m_counters.drops, 1);
+			HOT_LOG(DEBUG) << "Remove buffer block";
+		}
+	}
+
+	// Fills the pool by new blocks of the size up to its capacity. It's a warm up: gets don't allocate then
+	// while less then the capacity of blocks are in use, and pushes don't grow the storage
+	void prefill(size_t size)
+	{
+		lock_guard<decltype(m_mutex)> lock(m_mutex);
+		m_blocks.reserve(m_maxItemsCount);
+		while (m_blocks.size() < m_maxItemsCount)
+		{
+			m_blocks.push_back(make_unique<BlockT>(size));
+		}
+	}
+
+	// Free blocks over the scaled capacity are released immediately. An empty pool is still working, just slower
+	void setCapacityScale(double scale) override
+	{
+		const size_t itemsCount = static_cast<size_t>(m_configuredItemsCount * scale);
+		unique_lock<decltype(m_mutex)> lock(m_mutex);
+		m_maxItemsCount = itemsCount;
+		if (m_blocks.size() > itemsCount)
+		{
+			m_blocks.resize(itemsCount);
 		}
+		lock.unlock();
+		LOG(INFO) << "Pool capacity is set to " << itemsCount << " blocks of " << m_configuredItemsCount;
+	}
+
+	const PoolCounters& getCounters() const
+	{
+		return m_counters;
 	}
 
 protected:
-	const size_t m_maxItemsCount;
-	std::queue<BlockPTR> m_blocks;
+	PoolCounters m_counters;
+	const size_t m_configuredItemsCount;
+	size_t m_maxItemsCount; // Current capacity. It's less then configured one on memory pressure
+	// The last returned block is given first. It's the warmest one in caches.
+	// Unlike std::queue the vector doesn't allocate on pushes after it has grown to the capacity
+	std::vector<BlockPTR> m_blocks;
 	std::mutex m_mutex;
 };
 }
\ No newline at end of file
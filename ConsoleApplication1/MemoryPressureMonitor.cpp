@@ -0,0 +1,111 @@
+#include "MemoryPressureMonitor.h"
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include "easylogging++.h"
+
+namespace transformation_stream
+{
+namespace
+{
+	const char* PSI_MEMORY_FILE = "/proc/pressure/memory";
+	const auto PSI_POLL_INTERVAL = std::chrono::seconds(1);
+	const double MIN_CAPACITY_SCALE = 1.0 / 16;
+}
+
+MemoryPressureMonitor::MemoryPressureMonitor(std::vector<IResizableBuffer*> buffers, double highThreshold, double lowThreshold) :
+	m_buffers(std::move(buffers)),
+	m_highThreshold(highThreshold),
+	m_lowThreshold(lowThreshold),
+	m_scale(1.0),
+	m_needStop(false)
+{
+	if (m_lowThreshold > m_highThreshold)
+	{
+		throw std::invalid_argument("Low memory pressure threshold should not be larger then the high one.");
+	}
+	m_backgroundMonitor = std::make_unique<std::thread>(&MemoryPressureMonitor::backgroundMonitoring, this);
+}
+
+MemoryPressureMonitor::~MemoryPressureMonitor()
+{
+	stop();
+}
+
+void MemoryPressureMonitor::stop()
+{
+	if (m_needStop.exchange(true))
+		return;
+
+	{
+		std::lock_guard<decltype(m_stopMutex)> lock(m_stopMutex);
+	}
+	m_stopCV.notify_one();
+	m_backgroundMonitor->join();
+}
+
+double MemoryPressureMonitor::readMemoryPressure()
+{
+	// Format: "some avg10=0.00 avg60=0.00 avg300=0.00 total=0"
+	std::ifstream psiFile(PSI_MEMORY_FILE);
+	std::string line;
+	while (std::getline(psiFile, line))
+	{
+		std::istringstream fields(line);
+		std::string kind, avg10;
+		if (fields >> kind >> avg10 && kind == "some" && avg10.compare(0, 6, "avg10=") == 0)
+		{
+			try
+			{
+				return std::stod(avg10.substr(6));
+			}
+			catch (const std::exception&)
+			{
+				break;
+			}
+		}
+	}
+	return -1;
+}
+
+void MemoryPressureMonitor::applyScale(double scale)
+{
+	if (scale == m_scale)
+		return;
+
+	m_scale = scale;
+	for (auto buffer : m_buffers)
+	{
+		buffer->setCapacityScale(m_scale);
+	}
+}
+
+void MemoryPressureMonitor::backgroundMonitoring()
+{
+	LOG(INFO) << "Memory pressure monitor is started. Thresholds " << m_lowThreshold << "%-" << m_highThreshold << "%";
+	std::unique_lock<decltype(m_stopMutex)> lock(m_stopMutex);
+	while (!m_needStop)
+	{
+		const double pressure = readMemoryPressure();
+		if (pressure < 0)
+		{
+			LOG(WARNING) << "Memory pressure isn't available in " << PSI_MEMORY_FILE << ". Monitor is stopped";
+			return;
+		}
+		if (pressure > m_highThreshold && m_scale > MIN_CAPACITY_SCALE)
+		{
+			LOG(WARNING) << "Memory pressure " << pressure << "%. Shrink buffers";
+			applyScale(std::max(m_scale / 2, MIN_CAPACITY_SCALE));
+		}
+		else if (pressure < m_lowThreshold && m_scale < 1.0)
+		{
+			LOG(INFO) << "Memory pressure " << pressure << "%. Grow buffers";
+			applyScale(std::min(m_scale * 2, 1.0));
+		}
+		m_stopCV.wait_for(lock, PSI_POLL_INTERVAL, [this]() { return m_needStop.load(); });
+	}
+}
+}
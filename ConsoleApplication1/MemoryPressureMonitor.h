@@ -0,0 +1,46 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include "IResizableBuffer.h"
+
+namespace transformation_stream
+{
+// A background monitor of the memory pressure (PSI, /proc/pressure/memory).
+// It halves capacity of the buffers while "some avg10" pressure is higher then highThreshold
+// and doubles it back while pressure is lower then lowThreshold. So the conveyer works slower
+// but doesn't push the host to memory reclaim.
+class MemoryPressureMonitor
+{
+public:
+	// buffers - buffers to resize. They should outlive the monitor
+	// highThreshold, lowThreshold - percents of time when tasks were stalled on memory
+	MemoryPressureMonitor(std::vector<IResizableBuffer*> buffers, double highThreshold, double lowThreshold);
+
+	virtual ~MemoryPressureMonitor();
+
+	// Stop the background monitoring. Buffers keep their current capacity
+	void stop();
+
+private:
+	void backgroundMonitoring();
+
+	// Returns "some avg10" value of the memory pressure, or a negative value if PSI isn't available
+	static double readMemoryPressure();
+
+	void applyScale(double scale);
+
+	const std::vector<IResizableBuffer*> m_buffers;
+	const double m_highThreshold;
+	const double m_lowThreshold;
+	double m_scale;
+
+	std::atomic<bool> m_needStop;
+	std::mutex m_stopMutex;
+	std::condition_variable m_stopCV;
+	std::unique_ptr<std::thread> m_backgroundMonitor;
+};
+}
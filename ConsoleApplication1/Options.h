@@ -14,7 +14,26 @@ namespace options
 	{
 		None = 0,
 		GetHelp = 1,
-		GetSignature = 2
+		GetSignature = 2,
+		ShowTop = 3, // Display live statistics of a running process
+		RunBenchmarks = 4, // Run micro-benchmarks of hot paths
+		RunHashBenchmark = 5, // Hash synthetic in-memory data without disk IO
+		RunSweep = 6, // Run signatures of generated files by a grid of settings
+		RunDaemon = 7 // Serve signature requests on a Unix socket
+	};
+
+	// Settings of the sweep as they are on the command line. Lists are comma separated
+	struct SweepOptions
+	{
+		std::string csvFile;
+		std::string directory = { "." };
+		std::string fileSizes = { "64M" };
+		std::string sampleSizes = { "4K,64K,1M" };
+		std::string ioBlockSizes = { "64K,1M" };
+		std::string bufferSizes = { "256K,3M,16M" };
+		std::string backends = { "stdio,fused" };
+		bool isWarm = { false };
+		size_t repeats = { 1 };
 	};
 
 	namespace units
@@ -30,6 +49,32 @@ namespace options
 		size_t sampleSize = { 1 * units::MB };
 		size_t ioPortionSize = { 1 * units::MB };
 		size_t maxBufferSize = { 3 * units::MB };
+		std::string cpuAffinity; // CPU list for conveyer threads. Empty - no binding
+		int numaNode = { -1 }; // NUMA node for conveyer threads and their memory. -1 - no binding
+		bool psiMonitor = { false }; // Shrink buffers on memory pressure
+		double psiHighThreshold = { 10 }; // percents of stalled time
+		double psiLowThreshold = { 1 }; // percents of stalled time
+		std::string waitStrategy = { "block" }; // block, spin-then-park or spin. See WaitStrategy.h
+		bool fuseStages = { false }; // Transform in the reader thread while reads are fast
+		size_t fusedBlockSize = { 256 * units::KB };
+		double fuseRatio = { 0.25 }; // Fuse while read time < fuseRatio * transformation time
+		size_t hashTileSize = { 64 * units::KB }; // Hashing walks blocks by tiles of this size. 0 - no tiling
+		std::string statsJson; // A file for the runtime statistics report. Empty - no report
+		double progressInterval = { 0 }; // seconds. 0 - no progress reports
+		std::string progressFormat = { "human" }; // human or machine
+		std::string statsShm; // A name of the shared memory segment for live statistics. Empty - no segment
+		std::string traceFile; // A file for the Chrome trace-event timeline of blocks. Empty - no tracing
+		bool perfCounters = { false }; // Count CPU events of the conveyer threads by perf_event_open
+		bool asyncLog = { false }; // Write logs by a background thread
+		size_t benchBytes = { 256 * units::MB }; // Data volume of a hash benchmark run
+		std::string simulatedStorage; // hdd, nvme or cloud. Read the source file if it's empty
+		size_t simulatedSize = { 1024 * units::MB }; // Bytes of the simulated file
+		double simulatedLatencyUs = { -1 }; // Overrides the profile's median latency if it isn't negative
+		double simulatedBandwidth = { 0 }; // MB/s. Overrides the profile's bandwidth if it's positive
+		size_t simulatedConcurrency = { 0 }; // Overrides the profile's requests in flight if it's positive
+		std::string daemonSocket; // A Unix socket of the daemon mode
+		size_t daemonJobs = { 0 }; // Signatures of the daemon at the same time. 0 - by the CPU budget
+		size_t daemonMemory = { 256 * units::MB }; // Bytes of blocks of all daemon jobs
 
 		void check()
 		{
@@ -51,6 +96,21 @@ namespace options
 					"It is a performance optimization of the parallel work";
 				throw std::invalid_argument(err);
 			}
+			if (numaNode < -1) {
+				throw std::invalid_argument("NUMA node should be a node number or -1.");
+			}
+			if (fuseStages && (fusedBlockSize <= 0 || fusedBlockSize > ioPortionSize || fuseRatio <= 0)) {
+				throw std::invalid_argument("Fused block size should be positive and not larger then IO block. Fuse ratio should be positive.");
+			}
+			if (!simulatedStorage.empty() && fuseStages) {
+				throw std::invalid_argument("The fused mode reads files only. It can't be used with a simulated storage.");
+			}
+			if (progressInterval < 0) {
+				throw std::invalid_argument("Progress interval should not be negative.");
+			}
+			if (psiLowThreshold < 0 || psiLowThreshold > psiHighThreshold || psiHighThreshold > 100) {
+				throw std::invalid_argument("Memory pressure thresholds should be 0 <= psi-low <= psi-high <= 100.");
+			}
 
 		}
 	};
@@ -72,7 +132,89 @@ namespace options
 							("ioblock,b", po::value<size_t>(&m_sigSettings.ioPortionSize),
 								"a size (in bytes) of the block for communication with a file system. Default is 1 MB")
 								("iobuffer,c", po::value<size_t>(&m_sigSettings.maxBufferSize),
-									"a size (in bytes) of the buffer for background data caching. Default is 3 MB");
+									"a size (in bytes) of the buffer for background data caching. Default is 3 MB")
+									("cpu-affinity", po::value<std::string>(&m_sigSettings.cpuAffinity),
+										"a list of CPUs for reader, hashing and writer threads. Format: 0-3,8. Default: no binding")
+									("numa-node", po::value<int>(&m_sigSettings.numaNode),
+										"a NUMA node for conveyer threads and their buffers. Default: -1 (no binding)")
+									("psi-monitor", po::bool_switch(&m_sigSettings.psiMonitor),
+										"shrink buffers on memory pressure (/proc/pressure/memory) and grow them back when it clears")
+									("psi-high", po::value<double>(&m_sigSettings.psiHighThreshold),
+										"memory pressure (some avg10, %) to shrink buffers on. Default is 10")
+									("psi-low", po::value<double>(&m_sigSettings.psiLowThreshold),
+										"memory pressure (some avg10, %) to grow buffers back on. Default is 1")
+									("wait-strategy", po::value<std::string>(&m_sigSettings.waitStrategy),
+										"a way of waiting on queues: block, spin-then-park or spin (for dedicated cores). Default: block")
+									("fuse", po::bool_switch(&m_sigSettings.fuseStages),
+										"hash in the reader thread while reads are fast (page cache), queue blocks to the hashing thread otherwise")
+									("fuse-block", po::value<size_t>(&m_sigSettings.fusedBlockSize),
+										"a size (in bytes) of reads in the fused mode. It should fit in L2 cache. Default is 256 KB")
+									("fuse-ratio", po::value<double>(&m_sigSettings.fuseRatio),
+										"the fused mode is on while read time is less then this part of hashing time. Default is 0.25")
+									("hash-tile", po::value<size_t>(&m_sigSettings.hashTileSize),
+										"a size (in bytes) of tiles for hashing with a prefetch of the next tile. 0 - no tiling. Default is 64 KB")
+									("stats-json", po::value<std::string>(&m_sigSettings.statsJson),
+										"a path to a JSON file for per-stage runtime statistics written at exit")
+									("progress", po::value<double>(&m_sigSettings.progressInterval),
+										"print progress, throughput and ETA to stderr each N seconds, rounded up to milliseconds. Default: 0 (off)")
+									("progress-format", po::value<std::string>(&m_sigSettings.progressFormat),
+										"a format of progress lines: human or machine (key=value). Default: human")
+									("stats-shm", po::value<std::string>(&m_sigSettings.statsShm),
+										"a name of a POSIX shared memory segment to publish live per-stage statistics")
+									("top", po::value<std::string>(&m_topName),
+										"display live statistics published by a running process with --stats-shm NAME")
+									("bench", po::value<std::string>(&m_benchSuite),
+										"run a suite of micro-benchmarks of hot paths instead of a signature: logging, queue, pool, md5, conveyer, steady, signer or all")
+									("bench-baseline", po::value<std::string>(&m_benchBaseline),
+										"compare --bench results with the baseline file. It fails if they are slower or allocate more. Allocations are counted by a build with FS_COUNT_ALLOCATIONS")
+									("bench-save", po::value<std::string>(&m_benchSave),
+										"save --bench results to the file as a new baseline")
+									("bench-tolerance", po::value<double>(&m_benchTolerance),
+										"allowed slowdown against --bench-baseline. Default: 0.25 (25%)")
+									("trace", po::value<std::string>(&m_sigSettings.traceFile),
+										"a path to a JSON file for a per-block timeline of the conveyer (Chrome trace-event format)")
+									("perf-counters", po::bool_switch(&m_sigSettings.perfCounters),
+										"count cycles, instructions, LLC and dTLB misses of each stage's thread (Linux)")
+									("async-log", po::bool_switch(&m_sigSettings.asyncLog),
+										"write logs by a background thread. Conveyer threads don't wait for the log file")
+									("bench-hash", po::bool_switch(&m_isHashBenchmark),
+										"measure hashing GB/s on synthetic in-memory data without disk IO, for --blocksize and --hash-tile")
+									("bench-bytes", po::value<size_t>(&m_sigSettings.benchBytes),
+										"data volume in bytes of each --bench-hash run. Default: 256 MB")
+									("simulate", po::value<std::string>(&m_sigSettings.simulatedStorage),
+										"read synthetic data with timings of a storage class instead of the source file: hdd, nvme or cloud")
+									("sim-size", po::value<size_t>(&m_sigSettings.simulatedSize),
+										"a size (in bytes) of the simulated file. Default: 1 GB")
+									("sim-latency-us", po::value<double>(&m_sigSettings.simulatedLatencyUs),
+										"a median latency of simulated requests in microseconds. Default: by the storage class")
+									("sim-bandwidth", po::value<double>(&m_sigSettings.simulatedBandwidth),
+										"a bandwidth of the simulated storage in MB/s. Default: by the storage class")
+									("sim-concurrency", po::value<size_t>(&m_sigSettings.simulatedConcurrency),
+										"simulated requests in flight. Default: by the storage class")
+									("sweep", po::value<std::string>(&m_sweepOptions.csvFile),
+										"run signatures of generated files for each combination of sweep lists and write results to the CSV file")
+									("sweep-dir", po::value<std::string>(&m_sweepOptions.directory),
+										"a directory for sweep test files. Default: current")
+									("sweep-sizes", po::value<std::string>(&m_sweepOptions.fileSizes),
+										"sizes of sweep test files. Default: 64M")
+									("sweep-blocksizes", po::value<std::string>(&m_sweepOptions.sampleSizes),
+										"--blocksize values of the sweep. Default: 4K,64K,1M")
+									("sweep-ioblocks", po::value<std::string>(&m_sweepOptions.ioBlockSizes),
+										"--ioblock values of the sweep. Default: 64K,1M")
+									("sweep-iobuffers", po::value<std::string>(&m_sweepOptions.bufferSizes),
+										"--iobuffer values of the sweep. Default: 256K,3M,16M")
+									("sweep-backends", po::value<std::string>(&m_sweepOptions.backends),
+										"read backends of the sweep: stdio, fused, sim-hdd, sim-nvme, sim-cloud. Default: stdio,fused")
+									("sweep-warm", po::bool_switch(&m_sweepOptions.isWarm),
+										"don't drop test files from the page cache before runs")
+									("sweep-repeats", po::value<size_t>(&m_sweepOptions.repeats),
+										"runs of each combination. Default: 1")
+									("daemon", po::value<std::string>(&m_sigSettings.daemonSocket),
+										"serve signature requests on the Unix socket with warm threads and pools, till SIGINT or SIGTERM")
+									("daemon-jobs", po::value<size_t>(&m_sigSettings.daemonJobs),
+										"signatures of the daemon at the same time. Default: 0 (a half of CPUs the process is allowed to use)")
+									("daemon-memory", po::value<size_t>(&m_sigSettings.daemonMemory),
+										"a bound (in bytes) of blocks, pooled digests and answer buffers of all daemon jobs. It limits jobs by --ioblock and --iobuffer. Default: 256 MB");
 		}
 
 		void Parse(int argc, const char* argv[])
@@ -85,6 +227,31 @@ namespace options
 				m_action = Action::GetHelp;
 				return;
 			}
+			if (vm.count("top"))
+			{
+				m_action = Action::ShowTop;
+				return;
+			}
+			if (vm.count("bench"))
+			{
+				m_action = Action::RunBenchmarks;
+				return;
+			}
+			if (m_isHashBenchmark)
+			{
+				m_action = Action::RunHashBenchmark;
+				return;
+			}
+			if (vm.count("sweep"))
+			{
+				m_action = Action::RunSweep;
+				return;
+			}
+			if (vm.count("daemon"))
+			{
+				m_action = Action::RunDaemon;
+				return;
+			}
 			if (!m_sigSettings.source.empty() && !m_sigSettings.result.empty())
 			{
 				m_action = Action::GetSignature;
@@ -96,6 +263,18 @@ namespace options
 
 		SignatureSettings GetSignatureSettings() { return m_sigSettings; }
 
+		const std::string& GetTopName() { return m_topName; }
+
+		const std::string& GetBenchSuite() { return m_benchSuite; }
+
+		const std::string& GetBenchBaseline() { return m_benchBaseline; }
+
+		const std::string& GetBenchSave() { return m_benchSave; }
+
+		double GetBenchTolerance() { return m_benchTolerance; }
+
+		const SweepOptions& GetSweepOptions() { return m_sweepOptions; }
+
 		void ShowHelp()
 		{
 			std::cout << m_description << std::endl;
@@ -103,6 +282,13 @@ namespace options
 
 	private:
 		SignatureSettings m_sigSettings;
+		std::string m_topName;
+		std::string m_benchSuite;
+		std::string m_benchBaseline;
+		std::string m_benchSave;
+		double m_benchTolerance = { 0.25 };
+		bool m_isHashBenchmark = { false };
+		SweepOptions m_sweepOptions;
 		Action m_action = { Action::None };
 		po::options_description m_description = { "Allowed options" };
 
@@ -0,0 +1,237 @@
+#include "PipelineStats.h"
+
+#include <algorithm>
+#include <cmath>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <stdexcept>
+
+namespace transformation_stream
+{
+namespace
+{
+	double toMilliseconds(uint64_t ns)
+	{
+		return ns / 1e6;
+	}
+
+	double toMicroseconds(uint64_t ns)
+	{
+		return ns / 1e3;
+	}
+
+	// The index of the highest set bit. The value should be positive
+	size_t getHighestBit(uint64_t value)
+	{
+#ifdef _MSC_VER
+		unsigned long bit = 0;
+		_BitScanReverse64(&bit, value);
+		return bit;
+#else
+		return 63 - __builtin_clzll(value);
+#endif
+	}
+
+	// MB/s by bytes processed for the time
+	double toMegabytesPerSecond(uint64_t bytes, uint64_t ns)
+	{
+		return ns ? (bytes / (1024.0 * 1024.0)) / (ns / 1e9) : 0;
+	}
+}
+
+void LatencyHistogram::record(uint64_t ns)
+{
+	m_buckets[getBucketIndex(ns)].fetch_add(1, std::memory_order_relaxed);
+	addRelaxed(m_count, 1);
+	addRelaxed(m_sum, ns);
+	uint64_t max = m_max.load(std::memory_order_relaxed);
+	while (ns > max && !m_max.compare_exchange_weak(max, ns, std::memory_order_relaxed))
+	{
+	}
+}
+
+uint64_t LatencyHistogram::getCount() const
+{
+	return m_count.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::getMax() const
+{
+	return m_max.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::getPercentile(double percent) const
+{
+	uint64_t total = 0;
+	for (const auto& bucket : m_buckets)
+	{
+		total += bucket.load(std::memory_order_relaxed);
+	}
+	if (total == 0)
+	{
+		return 0;
+	}
+	// The rank of the value which isn't less then the percent of all values
+	const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(total * std::min(percent, 100.0) / 100)));
+	uint64_t counted = 0;
+	for (size_t index = 0; index < BUCKETS_COUNT; ++index)
+	{
+		counted += m_buckets[index].load(std::memory_order_relaxed);
+		if (counted >= rank)
+		{
+			return std::min(getBucketUpperBound(index), getMax());
+		}
+	}
+	return getMax();
+}
+
+void LatencyHistogram::writeJson(std::ostream& out) const
+{
+	const uint64_t count = getCount();
+	out << "{\"count\": " << count
+		<< ", \"mean_us\": " << (count ? toMicroseconds(m_sum) / count : 0)
+		<< ", \"p50_us\": " << toMicroseconds(getPercentile(50))
+		<< ", \"p99_us\": " << toMicroseconds(getPercentile(99))
+		<< ", \"p999_us\": " << toMicroseconds(getPercentile(99.9))
+		<< ", \"max_us\": " << toMicroseconds(getMax()) << "}";
+}
+
+std::string LatencyHistogram::toString() const
+{
+	std::stringstream ss;
+	ss << std::fixed << std::setprecision(1) << "p50 " << toMicroseconds(getPercentile(50))
+		<< " us, p99 " << toMicroseconds(getPercentile(99))
+		<< " us, p99.9 " << toMicroseconds(getPercentile(99.9))
+		<< " us, max " << toMicroseconds(getMax()) << " us (" << getCount() << " values)";
+	return ss.str();
+}
+
+size_t LatencyHistogram::getBucketIndex(uint64_t value)
+{
+	if (value < SUB_BUCKETS)
+	{
+		return static_cast<size_t>(value);
+	}
+	const size_t highestBit = getHighestBit(value);
+	if (highestBit >= MAX_VALUE_BITS)
+	{
+		return BUCKETS_COUNT - 1;
+	}
+	// The highest bit selects the group, the next SUB_BUCKET_BITS bits select the bucket in it
+	const size_t shift = highestBit - SUB_BUCKET_BITS;
+	return (shift + 1) * SUB_BUCKETS + static_cast<size_t>((value >> shift) & (SUB_BUCKETS - 1));
+}
+
+uint64_t LatencyHistogram::getBucketUpperBound(size_t index)
+{
+	if (index < SUB_BUCKETS)
+	{
+		return index;
+	}
+	const size_t shift = index / SUB_BUCKETS - 1;
+	const uint64_t lowerBound = static_cast<uint64_t>(SUB_BUCKETS + index % SUB_BUCKETS) << shift;
+	return lowerBound + (static_cast<uint64_t>(1) << shift) - 1;
+}
+
+void StageCounters::writeJson(std::ostream& out) const
+{
+	out << "{\"bytes\": " << bytes
+		<< ", \"blocks\": " << blocks
+		<< ", \"busy_ms\": " << toMilliseconds(busyNs)
+		<< ", \"busy_mb_per_s\": " << toMegabytesPerSecond(bytes, busyNs)
+		<< ", \"latency\": ";
+	latency.writeJson(out);
+	if (flushes)
+	{
+		out << ", \"flushes\": " << flushes << ", \"flush_ms\": " << toMilliseconds(flushNs) << ", \"flush_latency\": ";
+		flushLatency.writeJson(out);
+	}
+	out << "}";
+}
+
+void QueueCounters::writeJson(std::ostream& out) const
+{
+	out << "{\"pushed_blocks\": " << pushedBlocks
+		<< ", \"pushed_bytes\": " << pushedBytes
+		<< ", \"popped_blocks\": " << poppedBlocks
+		<< ", \"popped_bytes\": " << poppedBytes
+		<< ", \"full_wait_ms\": " << toMilliseconds(fullWaitNs)
+		<< ", \"full_waits\": " << fullWaits
+		<< ", \"empty_wait_ms\": " << toMilliseconds(emptyWaitNs)
+		<< ", \"empty_waits\": " << emptyWaits
+		<< ", \"high_water_bytes\": " << highWaterBytes
+		<< ", \"high_water_blocks\": " << highWaterBlocks
+		<< ", \"time_in_queue\": ";
+	timeInQueue.writeJson(out);
+	out << "}";
+}
+
+void PoolCounters::writeJson(std::ostream& out) const
+{
+	const uint64_t getsCount = gets;
+	out << "{\"gets\": " << getsCount
+		<< ", \"hits\": " << hits
+		<< ", \"hit_rate\": " << (getsCount ? static_cast<double>(hits) / getsCount : 0)
+		<< ", \"resizes\": " << resizes
+		<< ", \"returns\": " << returns
+		<< ", \"drops\": " << drops << "}";
+}
+
+PipelineStats::PipelineStats() : m_start(std::chrono::steady_clock::now())
+{
+}
+
+void PipelineStats::add(const std::string& group, const std::string& name, const IStatsCounters& counters)
+{
+	m_entries.push_back({ group, name, &counters });
+}
+
+double PipelineStats::getWallSeconds() const
+{
+	return nanosecondsSince(m_start) / 1e9;
+}
+
+void PipelineStats::writeJson(std::ostream& out) const
+{
+	out << "{\n  \"wall_seconds\": " << getWallSeconds();
+	// Entries are grouped in the order of the first appearance of a group
+	std::vector<std::string> groups;
+	for (const auto& entry : m_entries)
+	{
+		if (std::find(groups.begin(), groups.end(), entry.group) == groups.end())
+		{
+			groups.push_back(entry.group);
+		}
+	}
+	for (const auto& group : groups)
+	{
+		out << ",\n  \"" << group << "\": {";
+		bool isFirst = true;
+		for (const auto& entry : m_entries)
+		{
+			if (entry.group != group)
+				continue;
+			out << (isFirst ? "\n" : ",\n") << "    \"" << entry.name << "\": ";
+			entry.counters->writeJson(out);
+			isFirst = false;
+		}
+		out << "\n  }";
+	}
+	out << "\n}\n";
+}
+
+void PipelineStats::writeJsonFile(const std::string& file) const
+{
+	std::ofstream out(file, std::ios::out | std::ios::trunc);
+	writeJson(out);
+	out.close();
+	if (!out)
+	{
+		throw std::runtime_error("Can't write statistics to " + file);
+	}
+}
+}
@@ -0,0 +1,143 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <ostream>
+
+namespace transformation_stream
+{
+// Runtime counters of the conveyer. Each component owns its counters and updates them on its own thread(s).
+// Reporters read them at any time, so all counters are atomics with relaxed semantics.
+struct IStatsCounters
+{
+	virtual ~IStatsCounters() = default;
+
+	// Write counters as a JSON object
+	virtual void writeJson(std::ostream& out) const = 0;
+};
+
+inline uint64_t nanosecondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+inline void addRelaxed(std::atomic<uint64_t>& counter, uint64_t value)
+{
+	counter.fetch_add(value, std::memory_order_relaxed);
+}
+
+// A histogram of latencies in nanoseconds with a bounded relative error like HdrHistogram.
+// Values are grouped by powers of two and each group is split to SUB_BUCKETS linear buckets. So the error is below 1/16.
+// Any thread records and reads it without locks.
+class LatencyHistogram : public IStatsCounters
+{
+public:
+	void record(uint64_t ns);
+
+	uint64_t getCount() const;
+	uint64_t getMax() const;
+
+	// The upper bound of the bucket of the percentile. percent is in [0, 100]
+	uint64_t getPercentile(double percent) const;
+
+	// {"count": ..., "mean_us": ..., "p50_us": ..., "p99_us": ..., "p999_us": ..., "max_us": ...}
+	void writeJson(std::ostream& out) const override;
+
+	// "p50 ... us, p99 ... us, p99.9 ... us, max ... us" for logs
+	std::string toString() const;
+
+private:
+	static constexpr size_t SUB_BUCKET_BITS = 4;
+	static constexpr size_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+	static constexpr size_t MAX_VALUE_BITS = 48; // About 78 hours. Larger values are counted in the last bucket
+	static constexpr size_t BUCKETS_COUNT = (MAX_VALUE_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+	static size_t getBucketIndex(uint64_t value);
+	static uint64_t getBucketUpperBound(size_t index);
+
+	std::atomic<uint64_t> m_buckets[BUCKETS_COUNT] = {};
+	std::atomic<uint64_t> m_count{ 0 };
+	std::atomic<uint64_t> m_sum{ 0 };
+	std::atomic<uint64_t> m_max{ 0 };
+};
+
+// Counters of a stage which processes blocks: reader, transformation strategy or writer
+struct StageCounters : IStatsCounters
+{
+	std::atomic<uint64_t> bytes{ 0 };
+	std::atomic<uint64_t> blocks{ 0 };
+	std::atomic<uint64_t> busyNs{ 0 }; // Time of the stage's own work: read, hashing or write calls
+	std::atomic<uint64_t> flushes{ 0 }; // The writer only. 0 on POSIX: writev doesn't need flushes
+	std::atomic<uint64_t> flushNs{ 0 }; // The writer only
+	LatencyHistogram latency; // Read or hash time of a block, write time of a batch
+	LatencyHistogram flushLatency; // The writer only
+
+	void addBlock(uint64_t blockBytes, uint64_t blockBusyNs)
+	{
+		addRelaxed(bytes, blockBytes);
+		addRelaxed(blocks, 1);
+		addRelaxed(busyNs, blockBusyNs);
+		latency.record(blockBusyNs);
+	}
+
+	void writeJson(std::ostream& out) const override;
+};
+
+struct QueueCounters : IStatsCounters
+{
+	std::atomic<uint64_t> pushedBlocks{ 0 };
+	std::atomic<uint64_t> pushedBytes{ 0 };
+	std::atomic<uint64_t> poppedBlocks{ 0 };
+	std::atomic<uint64_t> poppedBytes{ 0 };
+	std::atomic<uint64_t> fullWaitNs{ 0 }; // Pushers blocked on the full queue
+	std::atomic<uint64_t> fullWaits{ 0 };
+	std::atomic<uint64_t> emptyWaitNs{ 0 }; // Poppers blocked on the empty queue
+	std::atomic<uint64_t> emptyWaits{ 0 };
+	std::atomic<uint64_t> highWaterBytes{ 0 };
+	std::atomic<uint64_t> highWaterBlocks{ 0 };
+	LatencyHistogram timeInQueue; // From the push of a block till its pop
+
+	void writeJson(std::ostream& out) const override;
+};
+
+struct PoolCounters : IStatsCounters
+{
+	std::atomic<uint64_t> gets{ 0 };
+	std::atomic<uint64_t> hits{ 0 }; // Gets served by a pooled block
+	std::atomic<uint64_t> resizes{ 0 }; // Hits which needed a resize of the block
+	std::atomic<uint64_t> returns{ 0 };
+	std::atomic<uint64_t> drops{ 0 }; // Returned blocks released because the pool is full
+
+	void writeJson(std::ostream& out) const override;
+};
+
+// A set of named counters of the conveyer for a report at the exit
+class PipelineStats
+{
+public:
+	PipelineStats();
+
+	// Counters should outlive the report writing
+	void add(const std::string& group, const std::string& name, const IStatsCounters& counters);
+
+	double getWallSeconds() const;
+
+	// {"wall_seconds": ..., "<group>": {"<name>": {...}, ...}, ...}
+	void writeJson(std::ostream& out) const;
+
+	// Throws runtime_error if the file can't be written
+	void writeJsonFile(const std::string& file) const;
+
+private:
+	struct Entry
+	{
+		std::string group;
+		std::string name;
+		const IStatsCounters* counters;
+	};
+	std::vector<Entry> m_entries;
+	const std::chrono::steady_clock::time_point m_start;
+};
+}
@@ -0,0 +1,145 @@
+#include "PipelineTrace.h"
+
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+#include "easylogging++.h"
+
+namespace transformation_stream
+{
+std::atomic<bool> PipelineTrace::s_isEnabled{ false };
+
+namespace
+{
+	struct TraceEvent
+	{
+		char phase; // 'X' - a span, 'C' - a counter
+		const char* name;
+		const char* category;
+		uint64_t startNs; // Since the start of the trace
+		uint64_t durationNs;
+		uint64_t value; // Bytes of a span or a value of a counter
+	};
+
+	// A ring of one thread. Only its thread writes it, the dump reads it after the thread is finished
+	struct ThreadRing
+	{
+		explicit ThreadRing(size_t capacity, size_t threadId) : events(capacity), written(0), threadName(nullptr), tid(threadId)
+		{
+		}
+
+		std::vector<TraceEvent> events;
+		std::atomic<uint64_t> written;
+		const char* threadName;
+		const size_t tid;
+	};
+
+	std::mutex g_ringsMutex;
+	std::vector<std::unique_ptr<ThreadRing>> g_rings;
+	size_t g_eventsPerThread = 0;
+	std::chrono::steady_clock::time_point g_traceStart;
+	thread_local ThreadRing* t_ring = nullptr;
+
+	ThreadRing& getThreadRing()
+	{
+		if (!t_ring)
+		{
+			std::lock_guard<decltype(g_ringsMutex)> lock(g_ringsMutex);
+			g_rings.push_back(std::make_unique<ThreadRing>(g_eventsPerThread, g_rings.size() + 1));
+			t_ring = g_rings.back().get();
+		}
+		return *t_ring;
+	}
+
+	void addEvent(const TraceEvent& event)
+	{
+		auto& ring = getThreadRing();
+		const uint64_t written = ring.written.load(std::memory_order_relaxed);
+		ring.events[written % ring.events.size()] = event;
+		ring.written.store(written + 1, std::memory_order_release);
+	}
+
+	uint64_t sinceTraceStart(std::chrono::steady_clock::time_point time)
+	{
+		return time > g_traceStart ?
+			std::chrono::duration_cast<std::chrono::nanoseconds>(time - g_traceStart).count() : 0;
+	}
+}
+
+void PipelineTrace::enable(size_t eventsPerThread)
+{
+	if (eventsPerThread == 0)
+	{
+		throw std::invalid_argument("Trace ring should have a positive size");
+	}
+	g_eventsPerThread = eventsPerThread;
+	g_traceStart = std::chrono::steady_clock::now();
+	s_isEnabled.store(true, std::memory_order_release);
+}
+
+void PipelineTrace::setThreadName(const char* name)
+{
+	getThreadRing().threadName = name;
+}
+
+void PipelineTrace::addSpan(const char* name, const char* category, std::chrono::steady_clock::time_point start,
+	uint64_t durationNs, uint64_t bytes)
+{
+	addEvent({ 'X', name, category, sinceTraceStart(start), durationNs, bytes });
+}
+
+void PipelineTrace::addCounter(const char* name, uint64_t value)
+{
+	addEvent({ 'C', name, nullptr, sinceTraceStart(std::chrono::steady_clock::now()), 0, value });
+}
+
+void PipelineTrace::writeJsonFile(const std::string& file)
+{
+	std::ofstream out(file);
+	if (!out)
+	{
+		throw std::runtime_error("Can't open file " + file + " for the trace");
+	}
+	std::lock_guard<decltype(g_ringsMutex)> lock(g_ringsMutex);
+	uint64_t droppedCount = 0;
+	bool isFirst = true;
+	out << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [";
+	for (const auto& ring : g_rings)
+	{
+		out << (isFirst ? "\n" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << ring->tid
+			<< ", \"args\": {\"name\": \"" << (ring->threadName ? ring->threadName : "thread") << "\"}}";
+		isFirst = false;
+
+		const uint64_t written = ring->written.load(std::memory_order_acquire);
+		const size_t capacity = ring->events.size();
+		const uint64_t first = written > capacity ? written - capacity : 0;
+		droppedCount += first;
+		for (uint64_t index = first; index < written; ++index)
+		{
+			const auto& event = ring->events[index % capacity];
+			out << ",\n{\"name\": \"" << event.name << "\", \"ph\": \"" << event.phase << "\", \"pid\": 1, \"tid\": " << ring->tid
+				<< ", \"ts\": " << event.startNs / 1000.0;
+			if (event.phase == 'X')
+			{
+				out << ", \"cat\": \"" << event.category << "\", \"dur\": " << event.durationNs / 1000.0
+					<< ", \"args\": {\"bytes\": " << event.value << "}}";
+			}
+			else
+			{
+				out << ", \"args\": {\"bytes\": " << event.value << "}}";
+			}
+		}
+	}
+	out << "\n], \"otherData\": {\"dropped_events\": " << droppedCount << "}}\n";
+	if (!out)
+	{
+		throw std::runtime_error("Can't write the trace to file " + file);
+	}
+	if (droppedCount)
+	{
+		LOG(WARNING) << "Trace rings are overflowed. The first " << droppedCount << " events are lost";
+	}
+}
+}
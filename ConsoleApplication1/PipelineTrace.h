@@ -0,0 +1,78 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace transformation_stream
+{
+// A timeline of the conveyer in Chrome trace-event format. It's opened by ui.perfetto.dev or chrome://tracing.
+// Each thread records its events to an own ring without any synchronization. The oldest events are overwritten on overflow.
+// Tracing is off by default. Then every probe is just one relaxed load of a flag.
+class PipelineTrace
+{
+public:
+	static bool isEnabled()
+	{
+		return s_isEnabled.load(std::memory_order_relaxed);
+	}
+
+	// Start recording with rings of eventsPerThread events
+	static void enable(size_t eventsPerThread);
+
+	// Names and categories should outlive the dump: literals or names of the conveyer components.
+	// Probes should check isEnabled() before
+	static void setThreadName(const char* name);
+	static void addSpan(const char* name, const char* category, std::chrono::steady_clock::time_point start,
+		uint64_t durationNs, uint64_t bytes);
+	static void addCounter(const char* name, uint64_t value);
+
+	// Write all recorded events. Recording threads should be finished before.
+	// Throws runtime_error if the file can't be written
+	static void writeJsonFile(const std::string& file);
+
+private:
+	static std::atomic<bool> s_isEnabled;
+};
+
+// A span of the current scope
+class TraceSpan
+{
+public:
+	TraceSpan(const char* name, const char* category) :
+		m_name(name),
+		m_category(category),
+		m_isEnabled(PipelineTrace::isEnabled()),
+		m_bytes(0)
+	{
+		if (m_isEnabled)
+		{
+			m_start = std::chrono::steady_clock::now();
+		}
+	}
+
+	~TraceSpan()
+	{
+		if (m_isEnabled)
+		{
+			PipelineTrace::addSpan(m_name, m_category, m_start, std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now() - m_start).count(), m_bytes);
+		}
+	}
+
+	void setBytes(uint64_t bytes)
+	{
+		m_bytes = bytes;
+	}
+
+	TraceSpan(const TraceSpan&) = delete;
+	TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+	const char* m_name;
+	const char* m_category;
+	const bool m_isEnabled;
+	uint64_t m_bytes;
+	std::chrono::steady_clock::time_point m_start;
+};
+}
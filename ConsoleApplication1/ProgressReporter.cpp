@@ -0,0 +1,135 @@
+#include "ProgressReporter.h"
+
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+namespace transformation_stream
+{
+namespace
+{
+	const double MB = 1024.0 * 1024.0;
+
+	double secondsBetween(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to)
+	{
+		return std::chrono::duration<double>(to - from).count();
+	}
+
+	std::string formatDuration(double seconds)
+	{
+		if (seconds < 0)
+		{
+			return "--:--:--";
+		}
+		const auto total = static_cast<uint64_t>(seconds);
+		std::ostringstream out;
+		out << std::setfill('0') << std::setw(2) << total / 3600 << ":"
+			<< std::setw(2) << (total / 60) % 60 << ":" << std::setw(2) << total % 60;
+		return out.str();
+	}
+}
+
+ProgressReporter::Format ProgressReporter::parseFormat(const std::string& name)
+{
+	if (name == "human")
+		return Format::Human;
+	if (name == "machine")
+		return Format::Machine;
+	throw std::invalid_argument("Unknown progress format '" + name + "'. Allowed: human, machine");
+}
+
+ProgressReporter::ProgressReporter(const StageCounters& read, const StageCounters& processed, uint64_t totalBytes,
+	std::chrono::milliseconds interval, Format format, std::ostream& out) :
+	m_read(read),
+	m_processed(processed),
+	m_totalBytes(totalBytes),
+	m_interval(interval),
+	m_format(format),
+	m_out(out),
+	m_start(std::chrono::steady_clock::now()),
+	m_lastReportTime(m_start),
+	m_lastReportBytes(0),
+	m_needStop(false)
+{
+	if (m_interval.count() <= 0)
+	{
+		throw std::invalid_argument("Progress interval should have a positive value.");
+	}
+	m_backgroundReport = std::make_unique<std::thread>(&ProgressReporter::backgroundReporting, this);
+}
+
+ProgressReporter::~ProgressReporter()
+{
+	stopBackground();
+}
+
+void ProgressReporter::stop()
+{
+	if (stopBackground())
+	{
+		report(true);
+	}
+}
+
+bool ProgressReporter::stopBackground()
+{
+	if (m_needStop.exchange(true))
+		return false;
+
+	{
+		std::lock_guard<decltype(m_stopMutex)> lock(m_stopMutex);
+	}
+	m_stopCV.notify_one();
+	m_backgroundReport->join();
+	return true;
+}
+
+void ProgressReporter::backgroundReporting()
+{
+	std::unique_lock<decltype(m_stopMutex)> lock(m_stopMutex);
+	while (!m_stopCV.wait_for(lock, m_interval, [this]() { return m_needStop.load(); }))
+	{
+		report(false);
+	}
+}
+
+void ProgressReporter::report(bool isFinal)
+{
+	const auto now = std::chrono::steady_clock::now();
+	const uint64_t processed = m_processed.bytes.load(std::memory_order_relaxed);
+	const uint64_t read = m_read.bytes.load(std::memory_order_relaxed);
+	const double elapsed = secondsBetween(m_start, now);
+	const double sinceLast = secondsBetween(m_lastReportTime, now);
+	const double averageMBps = elapsed > 0 ? processed / MB / elapsed : 0;
+	const double currentMBps = sinceLast > 0 ? (processed - m_lastReportBytes) / MB / sinceLast : 0;
+	const double eta = (averageMBps > 0 && m_totalBytes >= processed) ? (m_totalBytes - processed) / MB / averageMBps : -1;
+	const double percent = m_totalBytes ? 100.0 * processed / m_totalBytes : 0;
+	m_lastReportTime = now;
+	m_lastReportBytes = processed;
+
+	// Manipulators go to a local stream, so flags and fill of the output stream stay as they are
+	std::ostringstream line;
+	line << std::fixed;
+	if (m_format == Format::Machine)
+	{
+		line << "progress elapsed_s=" << std::setprecision(3) << elapsed
+			<< " processed_bytes=" << processed << " read_bytes=" << read << " total_bytes=" << m_totalBytes
+			<< " percent=" << std::setprecision(2) << percent
+			<< " current_mbps=" << currentMBps << " average_mbps=" << averageMBps
+			<< " eta_s=" << std::setprecision(1) << eta << (isFinal ? " final=1" : "");
+		m_out << line.str() << std::endl;
+		return;
+	}
+	line << "\r[" << std::setprecision(1) << std::setw(5) << percent << "%] "
+		<< std::setprecision(1) << processed / MB << " MB / " << m_totalBytes / MB << " MB, "
+		<< currentMBps << " MB/s (avg " << averageMBps << " MB/s), "
+		<< (isFinal ? "elapsed " + formatDuration(elapsed) : "ETA " + formatDuration(eta)) << "   ";
+	m_out << line.str();
+	if (isFinal)
+	{
+		m_out << std::endl;
+	}
+	m_out.flush();
+}
+}
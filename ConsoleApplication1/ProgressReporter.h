@@ -0,0 +1,61 @@
+#pragma once
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <ostream>
+#include "PipelineStats.h"
+
+namespace transformation_stream
+{
+// A background periodic printer of the conveyer's progress: processed bytes of the file size,
+// instantaneous and average throughput and ETA. It only reads atomic counters of the stages.
+class ProgressReporter
+{
+public:
+	enum class Format
+	{
+		Human = 0, // One updating line for a terminal
+		Machine = 1 // key=value lines for scrapers
+	};
+
+	static Format parseFormat(const std::string& name);
+
+	// read - counters of the reader. processed - counters of the transformation.
+	// totalBytes - the file size. out - a stream for reports, usually std::cerr
+	ProgressReporter(const StageCounters& read, const StageCounters& processed, uint64_t totalBytes,
+		std::chrono::milliseconds interval, Format format, std::ostream& out);
+
+	// Stops the background thread without the final report. So a failed run doesn't look finished
+	virtual ~ProgressReporter();
+
+	// Prints the final report and stops the background thread
+	void stop();
+
+private:
+	// Returns false if it's stopped already
+	bool stopBackground();
+
+	void backgroundReporting();
+
+	void report(bool isFinal);
+
+	const StageCounters& m_read;
+	const StageCounters& m_processed;
+	const uint64_t m_totalBytes;
+	const std::chrono::milliseconds m_interval;
+	const Format m_format;
+	std::ostream& m_out;
+
+	const std::chrono::steady_clock::time_point m_start;
+	std::chrono::steady_clock::time_point m_lastReportTime;
+	uint64_t m_lastReportBytes;
+
+	std::atomic<bool> m_needStop;
+	std::mutex m_stopMutex;
+	std::condition_variable m_stopCV;
+	std::unique_ptr<std::thread> m_backgroundReport;
+};
+}
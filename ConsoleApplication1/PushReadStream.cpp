@@ -0,0 +1,89 @@
+#include "PushReadStream.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include "easylogging++.h"
+#include "HotLog.h"
+
+namespace transformation_stream
+{
+PushReadStream::PushReadStream(IStreamQueue& queue, IMemBlocksPool& memPool, size_t blockSize) :
+	m_queue(queue),
+	m_memPool(memPool),
+	m_blockSize(blockSize),
+	m_isEOF(false)
+{
+	if (m_blockSize == 0)
+	{
+		throw std::invalid_argument("Block size of the push stream should have a positive value");
+	}
+}
+
+PushReadStream::~PushReadStream()
+{
+	stop();
+}
+
+BlockPTR PushReadStream::getBlock(size_t size)
+{
+	return m_memPool.get(size);
+}
+
+void PushReadStream::push(BlockPTR block)
+{
+	if (m_isEOF)
+	{
+		throw std::logic_error("The push stream is already finished");
+	}
+	if (!block || block->empty())
+	{
+		m_memPool.push(std::move(block));
+		return;
+	}
+	const size_t blockSize = block->size();
+	m_counters.addBlock(blockSize, 0);
+	m_queue.push(std::move(block));
+	HOT_LOG(DEBUG) << "The pushed block of " << blockSize << " (B) has moved to queue";
+}
+
+void PushReadStream::write(const char_type* data, size_t size)
+{
+	for (size_t written = 0; written < size; )
+	{
+		const size_t portion = std::min(m_blockSize, size - written);
+		BlockPTR block = getBlock(portion);
+		memcpy(&(*block)[0], data + written, portion);
+		push(std::move(block));
+		written += portion;
+	}
+}
+
+void PushReadStream::finish()
+{
+	if (!m_isEOF.exchange(true))
+	{
+		m_queue.stopIncomes();
+	}
+}
+
+void PushReadStream::fail(const std::string& message)
+{
+	if (!m_isEOF.exchange(true))
+	{
+		LOG(ERROR) << "The push stream is failed: " << message;
+		m_queue.pushError(EINTR, message);
+	}
+}
+
+bool PushReadStream::isEOF()
+{
+	return m_isEOF;
+}
+
+void PushReadStream::stop()
+{
+	finish();
+}
+}
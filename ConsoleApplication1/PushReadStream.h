@@ -0,0 +1,62 @@
+#pragma once
+#include <atomic>
+#include "IReadStream.h"
+#include "IQueue.h"
+#include "IMemBlocksPool.h"
+#include "PipelineStats.h"
+#include "HardwareCounters.h"
+
+namespace transformation_stream
+{
+// An input stream which the caller feeds itself, like a service feeds a received upload.
+// There is no background thread: blocks are pushed to the conveyer's queue on the caller's thread,
+// and the push waits while the queue is full. So the caller is slowed down to the transformation speed.
+// A block from getBlock() could be filled in place (by recv() for example) and pushed without any copy.
+class PushReadStream : public IReadStream
+{
+public:
+	// blockSize - size of blocks which write() copies data by
+	PushReadStream(IStreamQueue& queue, IMemBlocksPool& memPool, size_t blockSize);
+
+	virtual ~PushReadStream();
+
+	// A block of the conveyer's pool for the caller to fill
+	BlockPTR getBlock(size_t size);
+
+	// Passes the filled block to the conveyer. Throws if the conveyer is stopped by an error
+	void push(BlockPTR block);
+
+	// Copies the data to blocks of the pool and pushes them
+	void write(const char_type* data, size_t size);
+
+	// The end of the stream. The conveyer finishes the last digest
+	void finish();
+
+	// Stops the conveyer by an error of the source
+	void fail(const std::string& message);
+
+	bool isEOF() override;
+
+	// The same as finish()
+	void stop() override;
+
+	const StageCounters& getCounters() const override
+	{
+		return m_counters;
+	}
+
+	// There is no thread of the stream. CPU time of pushes belongs to the caller
+	const HardwareCounters& getHardwareCounters() const override
+	{
+		return m_hardwareCounters;
+	}
+
+private:
+	IStreamQueue& m_queue;
+	IMemBlocksPool& m_memPool;
+	const size_t m_blockSize;
+	std::atomic<bool> m_isEOF;
+	StageCounters m_counters;
+	HardwareCounters m_hardwareCounters;
+};
+}
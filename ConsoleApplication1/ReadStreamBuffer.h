@@ -6,6 +6,7 @@
 #include <vector>
 #include <list>
 #include <mutex>
+#include <thread>
 #include <atomic>
 #include <ios>
 #include <functional>
@@ -13,11 +14,21 @@
 #include <string.h>
 #include <functional>
 #include "easylogging++.h"
+#include "HotLog.h"
 
 #include "CommonStreamBuffer.h"
 #include "IReadStream.h"
 #include "IQueue.h"
 #include "MemBlocksPool.h"
+#include "CpuTopology.h"
+#include "AdaptiveFusionStrategy.h"
+#include <chrono>
+#include "PipelineStats.h"
+#include "PipelineTrace.h"
+#include "HardwareCounters.h"
+#include "UsdtProbes.h"
+#include "WorkerThread.h"
+#include <future>
 
 using namespace std;
 namespace transformation_stream
@@ -33,8 +44,15 @@ public:
 	// file - name of file to read from
 	// maxBufferSize - Maximal size in bytes of an internal file cache
 	// blockSize - DataBlock size in bytes. It's a block size for communication with user and with disk
-	ReadStream(const std::string& file, IStreamQueue& queue, IMemBlocksPool& memPool, size_t blockSize) :
+	// placement - CPUs and NUMA node for the background thread
+	// fusion - if it's set, fast read blocks are transformed by the background thread itself instead of queueing
+	// worker - if it's set, the file is read on this long living thread instead of a new one
+	ReadStream(const std::string& file, IStreamQueue& queue, IMemBlocksPool& memPool, size_t blockSize,
+		const ThreadPlacement& placement = ThreadPlacement(), AdaptiveFusionStrategy* fusion = nullptr,
+		WorkerThread* worker = nullptr) :
 		m_IOBlockSize(blockSize),
+		m_placement(placement),
+		m_fusion(fusion),
 		m_queue(queue),
 		m_memPool(memPool),
 		m_file(nullptr),
@@ -59,7 +77,14 @@ public:
 			throwOnFileError(ss.str(), myErrno);
 		}
 		// run background thread of file read to buffer
-		m_backgroundRead = make_unique<thread>(std::bind(&ReadStream::backgroundWrittingToBuffer, this));
+		if (worker)
+		{
+			m_backgroundTask = worker->run(std::bind(&ReadStream::backgroundWrittingToBuffer, this));
+		}
+		else
+		{
+			m_backgroundRead = make_unique<thread>(std::bind(&ReadStream::backgroundWrittingToBuffer, this));
+		}
 	}
 
 	virtual ~ReadStream() 
@@ -73,6 +98,17 @@ public:
 		return m_isEOF;
 	}
 
+	const StageCounters& getCounters() const override
+	{
+		return m_counters;
+	}
+
+	// Blocks transformed inline by fusion are counted here too
+	const HardwareCounters& getHardwareCounters() const override
+	{
+		return m_hardwareCounters;
+	}
+
 	///Stop background read of file
 	void stop() override
 	{
@@ -81,7 +117,14 @@ public:
 
 		m_needStop = true;
 		finishRead();
-		m_backgroundRead->join();
+		if (m_backgroundRead)
+		{
+			m_backgroundRead->join();
+		}
+		else
+		{
+			m_backgroundTask.wait();
+		}
 	}
 private:
 
@@ -96,6 +139,13 @@ private:
 	{
 		size_t totalRead=0; //in bytes. Just for logs.
 		int myErrno = 0;
+		// Blocks of the pool are first touched here. So they are allocated on the node of the placement
+		m_placement.bindCurrentThread("ReadStream");
+		if (PipelineTrace::isEnabled())
+		{
+			PipelineTrace::setThreadName("ReadStream");
+		}
+		ThreadHardwareCounters threadCounters(m_hardwareCounters, "ReadStream");
 		try
 		{
 			while (!m_isEOF && !m_needStop)
@@ -106,15 +156,24 @@ private:
 				}
 
 				bool isEndOfFile = false;
-				BlockPTR bufferPtr = m_memPool.get(m_IOBlockSize);
-				LOG(DEBUG) << "Start Reading new block from file";
+				// Fused reads are small to keep the block in the CPU cache till its transformation
+				const size_t readSize = (m_fusion && m_fusion->isFused()) ? m_fusion->getFusedBlockSize() : m_IOBlockSize;
+				BlockPTR bufferPtr = m_memPool.get(readSize);
+				HOT_LOG(DEBUG) << "Start Reading new block from file";
 
+				const auto readStart = chrono::steady_clock::now();
 #ifdef _WIN32
-				const size_t readCount = fread_s(&(*bufferPtr)[0], bufferPtr->size(), 1/*sizeof(char_type)*/, m_IOBlockSize, m_file);
+				const size_t readCount = fread_s(&(*bufferPtr)[0], bufferPtr->size(), 1/*sizeof(char_type)*/, readSize, m_file);
 #else
-				const size_t readCount = fread(&(*bufferPtr)[0], 1/*sizeof(char_type)*/, m_minIOSize, m_file);
+				const size_t readCount = fread(&(*bufferPtr)[0], 1/*sizeof(char_type)*/, readSize, m_file);
 #endif
-				if (readCount != m_IOBlockSize)
+				const uint64_t readNs = nanosecondsSince(readStart);
+				FS_PROBE2(block_read, readCount, readNs);
+				if (PipelineTrace::isEnabled())
+				{
+					PipelineTrace::addSpan("read", "ReadStream", readStart, readNs, readCount);
+				}
+				if (readCount != readSize)
 				{
 					myErrno = errno;
 					bufferPtr->resize(readCount);
@@ -139,9 +198,22 @@ private:
 				const auto bufSize = bufferPtr->size();
 				if (bufSize != 0)
 				{
-					m_queue.push(std::move(bufferPtr));
+					m_counters.addBlock(bufSize, readNs);
+					if (m_fusion)
+					{
+						bufferPtr = m_fusion->tryTransformInline(std::move(bufferPtr), readNs);
+					}
+					if (bufferPtr)
+					{
+						m_queue.push(std::move(bufferPtr));
+					}
 					totalRead += bufSize;
 				}
+				else
+				{
+					// The read at the end of the file. The block is kept by the pool for the next run
+					m_memPool.push(std::move(bufferPtr));
+				}
 
 				if (isEndOfFile)
 				{
@@ -149,7 +221,7 @@ private:
 					finishRead();
 				}				
 
-				LOG(DEBUG) << "The block of " << bufSize 
+				HOT_LOG(DEBUG) << "The block of " << bufSize 
 					<< " (B) has moved to queue. Total read " << totalRead;
 			}
 		}
@@ -161,15 +233,19 @@ private:
 			m_queue.pushError(EINTR, ss.str());
 			m_isEOF = true;
 		}
-		LOG(DEBUG) << "File has read till the end. Size " << totalRead << 
+		threadCounters.setBytes(totalRead);
+		HOT_LOG(DEBUG) << "File has read till the end. Size " << totalRead << 
 			"B. EOF=" << m_isEOF << "errno=" << myErrno;
 	}
 
 
 private:
 	const size_t m_IOBlockSize;//in bytes. Minimal chunk to read from disk.
+	const ThreadPlacement m_placement;
+	AdaptiveFusionStrategy* m_fusion;
 
 	unique_ptr<std::thread> m_backgroundRead;
+	std::future<void> m_backgroundTask; // The read on a worker thread
 
 	IStreamQueue& m_queue;
 	IMemBlocksPool& m_memPool;
@@ -177,6 +253,8 @@ private:
 	// State of backgroundly processing file stream
 	atomic<bool> m_isEOF;
 	atomic<bool> m_needStop;
+	StageCounters m_counters;
+	HardwareCounters m_hardwareCounters;
 };
 
 }// end of namespace stream_buffer
\ No newline at end of file
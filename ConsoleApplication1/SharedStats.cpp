@@ -0,0 +1,383 @@
+#include "SharedStats.h"
+
+#include <iostream>
+#include <iomanip>
+#include <stdexcept>
+#include <new>
+#include "CommonStreamBuffer.h"
+#include "easylogging++.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <cerrno>
+#endif
+
+namespace transformation_stream
+{
+namespace
+{
+	const double MB = 1024.0 * 1024.0;
+	const auto TOP_REFRESH_INTERVAL = std::chrono::seconds(1);
+	const size_t SPINS_PER_LIVENESS_CHECK = 1024; // A reader checks the writer between spins on an odd sequence
+
+	// A plain copy of the segment made by the reader
+	struct SharedStatsSnapshot
+	{
+		struct Stage { uint64_t bytes, blocks, busyNs; };
+		struct Queue { uint64_t depthBytes, depthBlocks, pushedBlocks, fullWaitNs, emptyWaitNs, highWaterBytes; };
+		uint64_t pid, elapsedNs, totalBytes, isFinished;
+		Stage stages[SharedStatsLayout::STAGES_COUNT];
+		Queue queues[SharedStatsLayout::QUEUES_COUNT];
+		uint64_t poolGets, poolHits;
+	};
+
+	const char* STAGE_NAMES[SharedStatsLayout::STAGES_COUNT] = { "read", "hash", "write" };
+	const char* QUEUE_NAMES[SharedStatsLayout::QUEUES_COUNT] = { "InQueue", "OutQueue" };
+
+	std::string getSegmentName(const std::string& name)
+	{
+#ifdef _WIN32
+		return "Local\\" + name;
+#else
+		return name.empty() || name[0] != '/' ? "/" + name : name;
+#endif
+	}
+
+	void store(std::atomic<uint64_t>& to, const std::atomic<uint64_t>& from)
+	{
+		to.store(from.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	}
+
+	uint64_t load(const std::atomic<uint64_t>& from)
+	{
+		return from.load(std::memory_order_relaxed);
+	}
+
+	bool isProcessAlive(uint64_t pid)
+	{
+#ifdef _WIN32
+		HANDLE process = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, static_cast<DWORD>(pid));
+		if (!process)
+		{
+			return GetLastError() == ERROR_ACCESS_DENIED;
+		}
+		DWORD exitCode = 0;
+		const bool isAlive = GetExitCodeProcess(process, &exitCode) && exitCode == STILL_ACTIVE;
+		CloseHandle(process);
+		return isAlive;
+#else
+		// EPERM - the process exists, but it's of another user
+		return pid > 0 && (kill(static_cast<pid_t>(pid), 0) == 0 || errno == EPERM);
+#endif
+	}
+
+	// Copies the segment under the sequence lock.
+	// Returns false if the writer has died in the middle of an update, so the sequence stays odd
+	bool readSnapshot(const SharedStatsLayout& layout, SharedStatsSnapshot& snapshot)
+	{
+		for (size_t spins = 1; ; ++spins)
+		{
+			const uint64_t sequence = layout.sequence.load(std::memory_order_acquire);
+			if (sequence & 1)
+			{
+				if (spins % SPINS_PER_LIVENESS_CHECK == 0 && !isProcessAlive(layout.pid.load(std::memory_order_relaxed)))
+				{
+					return false;
+				}
+				std::this_thread::yield();
+				continue;
+			}
+			snapshot.pid = load(layout.pid);
+			snapshot.elapsedNs = load(layout.elapsedNs);
+			snapshot.totalBytes = load(layout.totalBytes);
+			snapshot.isFinished = load(layout.isFinished);
+			for (size_t i = 0; i < SharedStatsLayout::STAGES_COUNT; ++i)
+			{
+				snapshot.stages[i] = { load(layout.stages[i].bytes), load(layout.stages[i].blocks), load(layout.stages[i].busyNs) };
+			}
+			for (size_t i = 0; i < SharedStatsLayout::QUEUES_COUNT; ++i)
+			{
+				const auto& queue = layout.queues[i];
+				snapshot.queues[i] = { load(queue.depthBytes), load(queue.depthBlocks), load(queue.pushedBlocks),
+					load(queue.fullWaitNs), load(queue.emptyWaitNs), load(queue.highWaterBytes) };
+			}
+			snapshot.poolGets = load(layout.poolGets);
+			snapshot.poolHits = load(layout.poolHits);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (layout.sequence.load(std::memory_order_relaxed) == sequence)
+			{
+				return true;
+			}
+		}
+	}
+
+	void printSnapshot(const SharedStatsSnapshot& current, const SharedStatsSnapshot& previous, std::ostream& out)
+	{
+		const double elapsed = current.elapsedNs / 1e9;
+		const double sincePrevious = (current.elapsedNs - previous.elapsedNs) / 1e9;
+		const uint64_t hashed = current.stages[SharedStatsLayout::HASH].bytes;
+		out << "pid " << current.pid << std::fixed << std::setprecision(1) << ", elapsed " << elapsed << " s, "
+			<< hashed / MB << " of " << current.totalBytes / MB << " MB ("
+			<< (current.totalBytes ? 100.0 * hashed / current.totalBytes : 0) << "%)"
+			<< (current.isFinished ? ", finished" : "") << "\n";
+		out << std::left << std::setw(10) << "stage" << std::right << std::setw(12) << "MB/s" << std::setw(12) << "busy %"
+			<< std::setw(14) << "blocks" << "\n";
+		for (size_t i = 0; i < SharedStatsLayout::STAGES_COUNT; ++i)
+		{
+			const auto& stage = current.stages[i];
+			const auto& before = previous.stages[i];
+			out << std::left << std::setw(10) << STAGE_NAMES[i] << std::right
+				<< std::setw(12) << (sincePrevious > 0 ? (stage.bytes - before.bytes) / MB / sincePrevious : 0)
+				<< std::setw(12) << (sincePrevious > 0 ? 100.0 * (stage.busyNs - before.busyNs) / 1e9 / sincePrevious : 0)
+				<< std::setw(14) << stage.blocks << "\n";
+		}
+		out << std::left << std::setw(10) << "queue" << std::right << std::setw(12) << "depth KB" << std::setw(12) << "blocks"
+			<< std::setw(14) << "full wait %" << std::setw(14) << "empty wait %" << std::setw(14) << "high KB" << "\n";
+		for (size_t i = 0; i < SharedStatsLayout::QUEUES_COUNT; ++i)
+		{
+			const auto& queue = current.queues[i];
+			const auto& before = previous.queues[i];
+			out << std::left << std::setw(10) << QUEUE_NAMES[i] << std::right
+				<< std::setw(12) << queue.depthBytes / 1024.0 << std::setw(12) << queue.depthBlocks
+				<< std::setw(14) << (sincePrevious > 0 ? 100.0 * (queue.fullWaitNs - before.fullWaitNs) / 1e9 / sincePrevious : 0)
+				<< std::setw(14) << (sincePrevious > 0 ? 100.0 * (queue.emptyWaitNs - before.emptyWaitNs) / 1e9 / sincePrevious : 0)
+				<< std::setw(14) << queue.highWaterBytes / 1024.0 << "\n";
+		}
+		out << "pool hit rate " << std::setprecision(3) << (current.poolGets ? static_cast<double>(current.poolHits) / current.poolGets : 0)
+			<< "\n" << std::endl;
+	}
+}
+
+SharedStatsPublisher::SharedStatsPublisher(const std::string& name, const SharedStatsSources& sources,
+	std::chrono::milliseconds interval) :
+	m_name(getSegmentName(name)),
+	m_sources(sources),
+	m_interval(interval),
+	m_start(std::chrono::steady_clock::now()),
+	m_layout(nullptr),
+	m_mappingHandle(nullptr),
+	m_needStop(false)
+{
+	void* memory = nullptr;
+#ifdef _WIN32
+	HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0,
+		static_cast<DWORD>(sizeof(SharedStatsLayout)), m_name.c_str());
+	const bool isExisting = mapping && GetLastError() == ERROR_ALREADY_EXISTS;
+	if (mapping)
+	{
+		memory = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(SharedStatsLayout));
+		if (!memory)
+		{
+			CloseHandle(mapping);
+		}
+	}
+	if (!memory)
+	{
+		throw std::runtime_error("Can't create shared memory " + m_name + ". Error " + std::to_string(GetLastError()));
+	}
+	// A mapping lives while it has handles. It's taken over only if it's left by a finished publisher for a reader
+	if (isExisting && isProcessAlive(static_cast<const SharedStatsLayout*>(memory)->pid.load(std::memory_order_relaxed)))
+	{
+		UnmapViewOfFile(memory);
+		CloseHandle(mapping);
+		throw std::runtime_error("Shared memory " + m_name + " is used by a running process");
+	}
+	m_mappingHandle = mapping;
+	const uint64_t pid = _getpid();
+#else
+	int fd = shm_open(m_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+	if (fd < 0 && errno == EEXIST)
+	{
+		// A segment of a crashed publisher is taken over. A segment of a running one or of another program isn't
+		uint64_t ownerPid = 0;
+		const int existingFd = shm_open(m_name.c_str(), O_RDONLY, 0);
+		struct stat segmentStat;
+		if (existingFd >= 0 && fstat(existingFd, &segmentStat) == 0 && segmentStat.st_size >= static_cast<off_t>(sizeof(SharedStatsLayout)))
+		{
+			void* existing = mmap(nullptr, sizeof(SharedStatsLayout), PROT_READ, MAP_SHARED, existingFd, 0);
+			if (existing != MAP_FAILED)
+			{
+				const auto* layout = static_cast<const SharedStatsLayout*>(existing);
+				if (layout->magic.load(std::memory_order_acquire) == SHARED_STATS_MAGIC)
+				{
+					ownerPid = layout->pid.load(std::memory_order_relaxed);
+				}
+				munmap(existing, sizeof(SharedStatsLayout));
+			}
+		}
+		if (existingFd >= 0)
+		{
+			close(existingFd);
+		}
+		if (ownerPid == 0 || isProcessAlive(ownerPid))
+		{
+			throw std::runtime_error("Shared memory " + m_name + " is used by " +
+				(ownerPid ? "a running process " + std::to_string(ownerPid) : std::string("another program")));
+		}
+		LOG(WARNING) << "Shared memory " << m_name << " of finished process " << ownerPid << " is taken over";
+		shm_unlink(m_name.c_str());
+		fd = shm_open(m_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+	}
+	if (fd < 0 || ftruncate(fd, sizeof(SharedStatsLayout)) != 0 ||
+		(memory = mmap(nullptr, sizeof(SharedStatsLayout), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+	{
+		const int myErrno = errno;
+		if (fd >= 0)
+		{
+			close(fd);
+			shm_unlink(m_name.c_str());
+		}
+		throwOnFileError("Can't create shared memory " + m_name, myErrno);
+	}
+	close(fd);
+	const uint64_t pid = getpid();
+#endif
+	// The memory is zeroed by the system, so atomics are valid before the layout is constructed
+	m_layout = new (memory) SharedStatsLayout;
+	m_layout->sequence.store(0, std::memory_order_relaxed);
+	m_layout->pid.store(pid, std::memory_order_relaxed);
+	m_layout->magic.store(SHARED_STATS_MAGIC, std::memory_order_relaxed);
+	m_layout->version.store(SHARED_STATS_VERSION, std::memory_order_release);
+	publish(false);
+	LOG(INFO) << "Live statistics are published to shared memory " << m_name;
+	m_backgroundPublish = std::make_unique<std::thread>(&SharedStatsPublisher::backgroundPublishing, this);
+}
+
+SharedStatsPublisher::~SharedStatsPublisher()
+{
+	stop();
+#ifdef _WIN32
+	UnmapViewOfFile(m_layout);
+	CloseHandle(static_cast<HANDLE>(m_mappingHandle));
+#else
+	munmap(m_layout, sizeof(SharedStatsLayout));
+	shm_unlink(m_name.c_str());
+#endif
+}
+
+void SharedStatsPublisher::stop()
+{
+	if (m_needStop.exchange(true))
+		return;
+
+	{
+		std::lock_guard<decltype(m_stopMutex)> lock(m_stopMutex);
+	}
+	m_stopCV.notify_one();
+	m_backgroundPublish->join();
+	publish(true);
+}
+
+void SharedStatsPublisher::backgroundPublishing()
+{
+	std::unique_lock<decltype(m_stopMutex)> lock(m_stopMutex);
+	while (!m_stopCV.wait_for(lock, m_interval, [this]() { return m_needStop.load(); }))
+	{
+		publish(false);
+	}
+}
+
+void SharedStatsPublisher::publish(bool isFinal)
+{
+	auto& layout = *m_layout;
+	const uint64_t sequence = layout.sequence.load(std::memory_order_relaxed);
+	layout.sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	layout.elapsedNs.store(nanosecondsSince(m_start), std::memory_order_relaxed);
+	layout.totalBytes.store(m_sources.totalBytes, std::memory_order_relaxed);
+	layout.isFinished.store(isFinal ? 1 : 0, std::memory_order_relaxed);
+	for (size_t i = 0; i < SharedStatsLayout::STAGES_COUNT; ++i)
+	{
+		const auto& stage = *m_sources.stages[i];
+		store(layout.stages[i].bytes, stage.bytes);
+		store(layout.stages[i].blocks, stage.blocks);
+		store(layout.stages[i].busyNs, stage.busyNs);
+	}
+	for (size_t i = 0; i < SharedStatsLayout::QUEUES_COUNT; ++i)
+	{
+		const auto& queue = *m_sources.queues[i];
+		auto& published = layout.queues[i];
+		// Pops are read first, so the depth isn't negative
+		const uint64_t poppedBytes = load(queue.poppedBytes);
+		const uint64_t poppedBlocks = load(queue.poppedBlocks);
+		published.depthBytes.store(load(queue.pushedBytes) - poppedBytes, std::memory_order_relaxed);
+		published.depthBlocks.store(load(queue.pushedBlocks) - poppedBlocks, std::memory_order_relaxed);
+		store(published.pushedBlocks, queue.pushedBlocks);
+		store(published.fullWaitNs, queue.fullWaitNs);
+		store(published.emptyWaitNs, queue.emptyWaitNs);
+		store(published.highWaterBytes, queue.highWaterBytes);
+	}
+	store(layout.poolGets, m_sources.pool->gets);
+	store(layout.poolHits, m_sources.pool->hits);
+
+	layout.sequence.store(sequence + 2, std::memory_order_release);
+}
+
+int runStatsTop(const std::string& name)
+{
+	const auto segmentName = getSegmentName(name);
+	const SharedStatsLayout* layout = nullptr;
+#ifdef _WIN32
+	HANDLE mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, segmentName.c_str());
+	if (mapping)
+	{
+		layout = static_cast<const SharedStatsLayout*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, sizeof(SharedStatsLayout)));
+	}
+#else
+	const int fd = shm_open(segmentName.c_str(), O_RDONLY, 0);
+	if (fd >= 0)
+	{
+		void* memory = mmap(nullptr, sizeof(SharedStatsLayout), PROT_READ, MAP_SHARED, fd, 0);
+		close(fd);
+		layout = (memory == MAP_FAILED) ? nullptr : static_cast<const SharedStatsLayout*>(memory);
+	}
+#endif
+	if (!layout)
+	{
+		std::cerr << "Error: Can't open live statistics " << segmentName << std::endl;
+		return -1;
+	}
+	if (layout->magic.load(std::memory_order_acquire) != SHARED_STATS_MAGIC ||
+		layout->version.load(std::memory_order_acquire) != SHARED_STATS_VERSION)
+	{
+		std::cerr << "Error: Unsupported layout of live statistics " << segmentName << std::endl;
+		return -1;
+	}
+
+	SharedStatsSnapshot previous = {};
+	SharedStatsSnapshot current = {};
+	bool isRead = readSnapshot(*layout, previous);
+	while (isRead)
+	{
+		std::this_thread::sleep_for(TOP_REFRESH_INTERVAL);
+		isRead = readSnapshot(*layout, current);
+		if (!isRead)
+		{
+			break;
+		}
+		printSnapshot(current, previous, std::cout);
+		previous = current;
+		if (current.isFinished)
+		{
+			return 0;
+		}
+		// A killed publisher doesn't mark the segment as finished
+		if (!isProcessAlive(current.pid))
+		{
+			std::cerr << "Error: Process " << current.pid << " of live statistics " << segmentName << " has gone" << std::endl;
+			return -1;
+		}
+	}
+	std::cerr << "Error: Process " << layout->pid.load(std::memory_order_relaxed) << " of live statistics "
+		<< segmentName << " has gone in the middle of an update" << std::endl;
+	return -1;
+}
+}
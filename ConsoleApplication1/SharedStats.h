@@ -0,0 +1,96 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <chrono>
+#include "PipelineStats.h"
+
+namespace transformation_stream
+{
+// A layout of the live statistics segment in shared memory.
+// The writer updates it under a sequence lock: sequence is odd while the data is changed.
+// A reader copies the data and retries if sequence was odd or has changed meanwhile.
+// Increase SHARED_STATS_VERSION on any change of the layout.
+static constexpr uint32_t SHARED_STATS_MAGIC = 0x54534646; // "FFST"
+static constexpr uint32_t SHARED_STATS_VERSION = 1;
+
+struct SharedStatsLayout
+{
+	struct Stage
+	{
+		std::atomic<uint64_t> bytes;
+		std::atomic<uint64_t> blocks;
+		std::atomic<uint64_t> busyNs;
+	};
+	struct Queue
+	{
+		std::atomic<uint64_t> depthBytes;
+		std::atomic<uint64_t> depthBlocks;
+		std::atomic<uint64_t> pushedBlocks;
+		std::atomic<uint64_t> fullWaitNs;
+		std::atomic<uint64_t> emptyWaitNs;
+		std::atomic<uint64_t> highWaterBytes;
+	};
+	enum StageIndex { READ = 0, HASH = 1, WRITE = 2, STAGES_COUNT = 3 };
+	enum QueueIndex { IN_QUEUE = 0, OUT_QUEUE = 1, QUEUES_COUNT = 2 };
+
+	std::atomic<uint32_t> magic;
+	std::atomic<uint32_t> version;
+	std::atomic<uint64_t> sequence;
+	std::atomic<uint64_t> pid;
+	std::atomic<uint64_t> elapsedNs;
+	std::atomic<uint64_t> totalBytes; // Size of the source file
+	std::atomic<uint64_t> isFinished;
+	Stage stages[STAGES_COUNT];
+	Queue queues[QUEUES_COUNT];
+	std::atomic<uint64_t> poolGets;
+	std::atomic<uint64_t> poolHits;
+};
+
+// Counters which are published to the segment. All of them should outlive the publisher
+struct SharedStatsSources
+{
+	const StageCounters* stages[SharedStatsLayout::STAGES_COUNT];
+	const QueueCounters* queues[SharedStatsLayout::QUEUES_COUNT];
+	const PoolCounters* pool;
+	uint64_t totalBytes;
+};
+
+// Publishes counters of the conveyer to a named shared memory segment periodically in a background thread.
+// The segment is removed when the publisher is destroyed.
+class SharedStatsPublisher
+{
+public:
+	SharedStatsPublisher(const std::string& name, const SharedStatsSources& sources, std::chrono::milliseconds interval);
+
+	virtual ~SharedStatsPublisher();
+
+	// Publishes the final state and stops the background thread
+	void stop();
+
+private:
+	void backgroundPublishing();
+
+	void publish(bool isFinal);
+
+	const std::string m_name;
+	const SharedStatsSources m_sources;
+	const std::chrono::milliseconds m_interval;
+	const std::chrono::steady_clock::time_point m_start;
+	SharedStatsLayout* m_layout;
+	void* m_mappingHandle; // Windows only
+
+	std::atomic<bool> m_needStop;
+	std::mutex m_stopMutex;
+	std::condition_variable m_stopCV;
+	std::unique_ptr<std::thread> m_backgroundPublish;
+};
+
+// Displays the live statistics segment of a running process each second till it's finished.
+// It's the "filesignature-top" tool. Returns a process exit code
+int runStatsTop(const std::string& name);
+}
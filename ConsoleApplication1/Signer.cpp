@@ -0,0 +1,226 @@
+#include "Signer.h"
+
+#include <stdexcept>
+#include <cstring>
+#include "ReadStreamBuffer.h"
+
+namespace transformation_stream
+{
+namespace
+{
+	// Digest blocks of the strategy are passed to the callback as digests with their numbers
+	CallbackSinkQueue::BlockCallback makeDigestSink(const DigestCallback& callback, uint64_t& digestIndex)
+	{
+		if (!callback)
+		{
+			throw std::invalid_argument("A digest callback should be set");
+		}
+		return [&callback, &digestIndex](const BlockT& block) {
+			Digest digest;
+			if (block.size() != digest.size())
+			{
+				throw std::logic_error("A digest block of " + std::to_string(block.size()) + " B is come");
+			}
+			memcpy(digest.data(), block.data(), digest.size());
+			ScopedLogRoute callerLogs(nullptr);
+			callback(digestIndex++, digest);
+		};
+	}
+}
+
+void SignerSettings::check() const
+{
+	if (sampleSize == 0 || ioBlockSize == 0)
+	{
+		throw std::invalid_argument("Sample and IO block sizes should have positive values.");
+	}
+	if (maxBufferSize < 2 * ioBlockSize)
+	{
+		throw std::invalid_argument("Maximal buffer size should be larger at list twice of IO block operation.");
+	}
+}
+
+SignatureLease::SignatureLease(std::atomic<bool>& isBusy) :
+	m_isBusy(isBusy)
+{
+	// A second signature would wait for the worker thread, which is busy with the first one
+	if (m_isBusy.exchange(true))
+	{
+		throw std::logic_error("The signer runs a signature already. Use a signer per concurrent signature");
+	}
+}
+
+SignatureLease::~SignatureLease()
+{
+	m_isBusy = false;
+}
+
+Signer::Signer(LogCallback logger) :
+	m_logger(std::move(logger)),
+	m_isBusy(false),
+	m_workerThread("SignerWorker", &m_logger),
+	m_poolItemsCount(0),
+	m_digestPool(MD5SignatureCalculationStrategy::MAX_POOLED_DIGESTS)
+{
+}
+
+size_t SignerSettings::getPoolItemsCount() const
+{
+	// The same sizing as FileSignature's one: blocks of the queue and of the engine's batch
+	const size_t batchMaxBytes = maxBufferSize / 2;
+	return (maxBufferSize + batchMaxBytes) / ioBlockSize + 1;
+}
+
+std::shared_ptr<MemBlocksPool> Signer::getBlocksPool(const SignerSettings& settings)
+{
+	const size_t itemsCount = settings.getPoolItemsCount();
+	if (!m_blocksPool || m_poolItemsCount != itemsCount)
+	{
+		m_blocksPool = std::make_shared<MemBlocksPool>(itemsCount);
+		m_poolItemsCount = itemsCount;
+	}
+	return m_blocksPool;
+}
+
+std::vector<Digest> Signer::sign(const std::string& path, const SignerSettings& settings)
+{
+	std::vector<Digest> digests;
+	sign(path, settings, [&digests](uint64_t, const Digest& digest) { digests.push_back(digest); });
+	return digests;
+}
+
+void Signer::sign(const std::string& path, const SignerSettings& settings, const DigestCallback& callback)
+{
+	ScopedLogRoute logRoute(m_logger);
+	SignatureLease lease(m_isBusy);
+	settings.check();
+	const size_t batchMaxBytes = settings.maxBufferSize / 2;
+	const auto blocksPool = getBlocksPool(settings);
+	uint64_t digestIndex = 0;
+	CallbackSinkQueue digests(makeDigestSink(callback, digestIndex), &m_digestPool);
+	LockingQueue inputQueue(settings.maxBufferSize, "SignerInQueue");
+	MD5SignatureCalculationStrategy strategy(digests, *blocksPool, settings.sampleSize, settings.hashTileSize, &m_digestPool);
+	ReadStream inputStream(path, inputQueue, *blocksPool, settings.ioBlockSize, ThreadPlacement(), nullptr, &m_workerThread);
+	TransformationEngine engine(inputQueue, digests, strategy, batchMaxBytes);
+	engine.transform();
+	digests.throwOnError();
+}
+
+std::vector<Digest> Signer::sign(const char_type* data, size_t size, const SignerSettings& settings)
+{
+	std::vector<Digest> digests;
+	digests.reserve(settings.sampleSize ? size / settings.sampleSize + 1 : 0);
+	sign(data, size, settings, [&digests](uint64_t, const Digest& digest) { digests.push_back(digest); });
+	return digests;
+}
+
+void Signer::sign(const char_type* data, size_t size, const SignerSettings& settings, const DigestCallback& callback)
+{
+	ScopedLogRoute logRoute(m_logger);
+	// The pools of the signer are shared with a live PushSignature
+	SignatureLease lease(m_isBusy);
+	settings.check();
+	if (!data && size)
+	{
+		throw std::invalid_argument("Data of a signature is null");
+	}
+	uint64_t digestIndex = 0;
+	CallbackSinkQueue digests(makeDigestSink(callback, digestIndex), &m_digestPool);
+	MD5SignatureCalculationStrategy strategy(digests, *getBlocksPool(settings), settings.sampleSize, settings.hashTileSize, &m_digestPool);
+	// Digests are passed by batches, so the data is hashed by IO blocks like a file would be
+	for (size_t shift = 0; shift < size; shift += settings.ioBlockSize)
+	{
+		strategy.transformBytes(data + shift, std::min(settings.ioBlockSize, size - shift));
+		strategy.flush();
+	}
+	strategy.dump();
+	strategy.flush();
+	digests.stopIncomes();
+}
+
+std::unique_ptr<PushSignature> Signer::startPush(const SignerSettings& settings, const DigestCallback& callback)
+{
+	ScopedLogRoute logRoute(m_logger);
+	settings.check();
+	return std::unique_ptr<PushSignature>(new PushSignature(*this, settings, callback));
+}
+
+PushSignature::PushSignature(Signer& signer, const SignerSettings& settings, const DigestCallback& callback) :
+	m_lease(signer.m_isBusy),
+	m_logger(signer.m_logger),
+	m_workerThread(signer.m_workerThread),
+	m_blocksPool(signer.getBlocksPool(settings)),
+	m_callback(callback),
+	m_digestIndex(0),
+	m_inputQueue(settings.maxBufferSize, "SignerPushQueue"),
+	m_digests(makeDigestSink(m_callback, m_digestIndex), &signer.m_digestPool),
+	m_strategy(m_digests, *m_blocksPool, settings.sampleSize, settings.hashTileSize, &signer.m_digestPool),
+	m_input(m_inputQueue, *m_blocksPool, settings.ioBlockSize),
+	m_engine(m_inputQueue, m_digests, m_strategy, settings.maxBufferSize / 2),
+	m_isFinished(false)
+{
+	m_transformation = signer.m_workerThread.run([this]() {
+		m_engine.transform();
+		m_digests.throwOnError();
+	});
+}
+
+PushSignature::~PushSignature()
+{
+	m_destructionLogRoute = std::make_unique<ScopedLogRoute>(m_logger);
+	if (!m_isFinished)
+	{
+		m_input.fail("The push signature is cancelled");
+		m_transformation.wait();
+	}
+}
+
+void PushSignature::throwIfStopped()
+{
+	// The transformation is finished before the end of the data only by an error
+	if (m_transformation.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+	{
+		m_isFinished = true;
+		m_transformation.get();
+		throw std::runtime_error("The push signature is stopped");
+	}
+}
+
+void PushSignature::throwIfInCallback() const
+{
+	// The callback runs on the worker thread, which is the only reader of the pushed data
+	if (m_workerThread.isCurrentThread())
+	{
+		throw std::logic_error("The push signature is fed from its digest callback");
+	}
+}
+
+void PushSignature::push(BlockPTR block)
+{
+	ScopedLogRoute logRoute(m_logger);
+	throwIfInCallback();
+	throwIfStopped();
+	m_input.push(std::move(block));
+}
+
+void PushSignature::write(const char_type* data, size_t size)
+{
+	ScopedLogRoute logRoute(m_logger);
+	throwIfInCallback();
+	throwIfStopped();
+	m_input.write(data, size);
+}
+
+void PushSignature::finish()
+{
+	ScopedLogRoute logRoute(m_logger);
+	throwIfInCallback();
+	if (m_isFinished)
+	{
+		throw std::logic_error("The push signature is already finished");
+	}
+	m_isFinished = true;
+	m_input.finish();
+	m_transformation.get();
+}
+}
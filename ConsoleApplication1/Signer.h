@@ -0,0 +1,159 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <future>
+#include "MemBlocksPool.h"
+#include "WorkerThread.h"
+#include "MD5SignatureCalculationStrategy.h"
+#include "LockingQueue.h"
+#include "CallbackSinkQueue.h"
+#include "PushReadStream.h"
+#include "TransformationEngine.h"
+#include "LogRoute.h"
+
+namespace transformation_stream
+{
+// An MD5 digest of a sample block. Bytes are the same as in the signature file of FileSignature
+using Digest = std::array<uint8_t, 16>;
+
+// index - a number of the sample block in the file, from 0
+using DigestCallback = std::function<void(uint64_t index, const Digest& digest)>;
+
+struct SignerSettings
+{
+	size_t sampleSize = 1024 * 1024; // A portion of data for one digest
+	size_t ioBlockSize = 1024 * 1024; // Size of reads
+	size_t maxBufferSize = 3 * 1024 * 1024; // Bound of the read ahead
+	size_t hashTileSize = MD5SignatureCalculationStrategy::DEFAULT_TILE_SIZE; // 0 - no tiling
+
+	// Throws invalid_argument on inacceptable settings
+	void check() const;
+
+	// Blocks of the read ahead and of the engine's batch. A signature holds up to this count of IO blocks
+	size_t getPoolItemsCount() const;
+};
+
+class Signer;
+
+// Marks a signer busy while it lives. Throws logic_error if the signer is busy already
+class SignatureLease
+{
+public:
+	explicit SignatureLease(std::atomic<bool>& isBusy);
+	~SignatureLease();
+
+	SignatureLease(const SignatureLease&) = delete;
+	SignatureLease& operator=(const SignatureLease&) = delete;
+
+private:
+	std::atomic<bool>& m_isBusy;
+};
+
+// A signature of data which the caller pushes by blocks, like a received upload. See Signer::startPush().
+// Digests are calculated on the worker thread of the signer and passed to the callback there.
+// The signer is busy till the destruction: it doesn't start other signatures and keeps its pools
+class PushSignature
+{
+public:
+	// A block of the signer's pool to fill in place. So the data is pushed without a copy
+	BlockPTR getBlock(size_t size)
+	{
+		return m_input.getBlock(size);
+	}
+
+	// Passes the block to the signature. It waits while the read ahead buffer is full.
+	// Throws an error of the signature (like an exception of the callback) if it's stopped.
+	// Push, write and finish throw logic_error in the digest callback: the signature would wait for itself
+	void push(BlockPTR block);
+
+	// Copies the data to blocks of IO block size and pushes them
+	void write(const char_type* data, size_t size);
+
+	// The end of the data. It waits for the last digest. Throws an error of the signature
+	void finish();
+
+	// An unfinished signature is cancelled
+	virtual ~PushSignature();
+
+	PushSignature(const PushSignature&) = delete;
+	PushSignature& operator=(const PushSignature&) = delete;
+
+private:
+	friend class Signer;
+
+	PushSignature(Signer& signer, const SignerSettings& settings, const DigestCallback& callback);
+
+	void throwIfStopped();
+	void throwIfInCallback() const;
+
+	SignatureLease m_lease;
+	const LogCallback& m_logger;
+	const WorkerThread& m_workerThread;
+	// Routes logs of the destruction of the members below. It's set by the destructor on its thread
+	std::unique_ptr<ScopedLogRoute> m_destructionLogRoute;
+	const std::shared_ptr<MemBlocksPool> m_blocksPool;
+	const DigestCallback m_callback;
+	uint64_t m_digestIndex;
+	LockingQueue m_inputQueue;
+	CallbackSinkQueue m_digests;
+	MD5SignatureCalculationStrategy m_strategy;
+	PushReadStream m_input;
+	TransformationEngine m_engine;
+	std::future<void> m_transformation;
+	bool m_isFinished;
+};
+
+// An in-process API of signatures for services which sign many files or buffers.
+// The conveyer of FileSignature runs without a process start and without logger.config:
+// - the file is read on a worker thread of the signer, which lives as long as the signer
+// - digests are calculated on the calling thread and passed to the caller without a writer thread
+// - blocks and digest blocks come from pools of the signer, so warm calls don't allocate per block
+// Data which is in memory already is signed without a file: in place or by pushes of the caller.
+// Logs of the conveyer on threads of the signer go to its logger only (see ScopedLogRoute). Without it there are no logs.
+// A signer runs one signature at a time. A call while a signature runs (on another thread, from a digest callback,
+// with a live PushSignature) throws logic_error. Use a signer per thread for parallel signatures
+class Signer
+{
+public:
+	explicit Signer(LogCallback logger = LogCallback());
+
+	virtual ~Signer() = default;
+
+	// Returns digests of the file. Throws runtime_error on IO errors and invalid_argument on wrong settings
+	std::vector<Digest> sign(const std::string& path, const SignerSettings& settings = SignerSettings());
+
+	// Passes digests to the callback in order of the file as soon as they are calculated.
+	// An exception of the callback stops the signature and is thrown from here
+	void sign(const std::string& path, const SignerSettings& settings, const DigestCallback& callback);
+
+	// Digests of the caller's memory. It's hashed in place on the calling thread: no copies, queues or threads
+	std::vector<Digest> sign(const char_type* data, size_t size, const SignerSettings& settings = SignerSettings());
+
+	void sign(const char_type* data, size_t size, const SignerSettings& settings, const DigestCallback& callback);
+
+	// Starts a signature of data which the caller pushes. The signer should outlive it
+	std::unique_ptr<PushSignature> startPush(const SignerSettings& settings, const DigestCallback& callback);
+
+	Signer(const Signer&) = delete;
+	Signer& operator=(const Signer&) = delete;
+
+private:
+	friend class PushSignature;
+
+	// The blocks pool is kept while the buffer and the IO block are the same
+	std::shared_ptr<MemBlocksPool> getBlocksPool(const SignerSettings& settings);
+
+	const LogCallback m_logger;
+	std::atomic<bool> m_isBusy;
+	// Reads files or runs the transformation of pushed data
+	WorkerThread m_workerThread;
+	std::shared_ptr<MemBlocksPool> m_blocksPool;
+	size_t m_poolItemsCount;
+	MemBlocksPool m_digestPool;
+};
+}
@@ -0,0 +1,544 @@
+#include "SignerDaemon.h"
+
+#include <stdexcept>
+#include "easylogging++.h"
+
+#ifndef _WIN32
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <list>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <cerrno>
+#include <csignal>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "CpuTopology.h"
+#include "CommonStreamBuffer.h"
+#endif
+
+namespace transformation_stream
+{
+#ifndef _WIN32
+namespace
+{
+	const size_t MAX_CONNECTIONS = 128;
+	const size_t MAX_REQUEST_SIZE = 64 * 1024;
+	const size_t ANSWER_BUFFER_SIZE = 64 * 1024; // Digest lines are sent by portions of this size
+	const size_t MAX_DIGEST_LINE_SIZE = 64;
+	const int POLL_TIMEOUT_MS = 200; // How often waiting threads check a stop
+	// A client which doesn't take a portion of answers for this time is dropped. So it doesn't keep a job slot
+	const auto SEND_TIMEOUT = std::chrono::seconds(5);
+	// A digest of the pool: the vector, its 16 B and heap headers of both allocations
+	const uint64_t POOLED_DIGEST_MEMORY = sizeof(BlockT) + sizeof(Digest) + 2 * 16;
+
+	std::atomic<bool> g_needStop(false);
+
+	void onStopSignal(int)
+	{
+		g_needStop = true;
+	}
+
+	// A signer and an answer buffer of a job. Both keep their memory between jobs
+	struct JobSlot
+	{
+		JobSlot()
+		{
+			answer.reserve(ANSWER_BUFFER_SIZE + MAX_DIGEST_LINE_SIZE);
+		}
+
+		Signer signer;
+		std::string answer; // Digest lines which aren't sent yet
+	};
+
+	// Memory of a job slot: blocks and digests of the signer's pools and the answer buffer
+	uint64_t getJobMemory(const SignerSettings& settings)
+	{
+		return static_cast<uint64_t>(settings.getPoolItemsCount()) * settings.ioBlockSize +
+			MD5SignatureCalculationStrategy::MAX_POOLED_DIGESTS * POOLED_DIGEST_MEMORY +
+			ANSWER_BUFFER_SIZE + MAX_DIGEST_LINE_SIZE;
+	}
+
+	// Job slots keep their signers' threads and pools between jobs.
+	// A free slot goes to the longest waiting request. Each connection has one request at a time,
+	// so a client with a lot of requests doesn't take slots from other clients.
+	class JobSlots
+	{
+	public:
+		explicit JobSlots(size_t count) :
+			m_nextTicket(0),
+			m_servedTicket(0),
+			m_isStopping(false)
+		{
+			for (size_t i = 0; i < count; ++i)
+			{
+				m_slots.push_back(std::make_unique<JobSlot>());
+				m_free.push_back(m_slots.back().get());
+			}
+		}
+
+		// Throws runtime_error if the daemon stops before a slot is free. A job isn't started then.
+		// hasSlot is set under the lock, so stop() sees all slots which are taken before it
+		JobSlot& acquire(std::atomic<bool>& hasSlot)
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			const uint64_t ticket = m_nextTicket++;
+			// A stop signal doesn't notify. It's checked by the poll timeout till stop() is called
+			while (!m_freeCV.wait_for(lock, std::chrono::milliseconds(POLL_TIMEOUT_MS), [this, ticket]() {
+				return m_isStopping || g_needStop || (ticket == m_servedTicket && !m_free.empty()); }))
+			{
+			}
+			if (m_isStopping || g_needStop)
+			{
+				// Later tickets stop too, so the served ticket isn't moved
+				throw std::runtime_error("daemon is stopping");
+			}
+			++m_servedTicket;
+			hasSlot = true;
+			JobSlot* slot = m_free.back();
+			m_free.pop_back();
+			// The next ticket could wait for a slot which is free yet
+			m_freeCV.notify_all();
+			return *slot;
+		}
+
+		void release(JobSlot& slot)
+		{
+			// Lines of a failed job aren't sent
+			slot.answer.clear();
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_free.push_back(&slot);
+			m_freeCV.notify_all();
+		}
+
+		// Slots aren't given after it
+		void stop()
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_isStopping = true;
+			m_freeCV.notify_all();
+		}
+
+	private:
+		std::mutex m_mutex;
+		std::condition_variable m_freeCV;
+		std::vector<std::unique_ptr<JobSlot>> m_slots;
+		std::vector<JobSlot*> m_free;
+		uint64_t m_nextTicket;
+		uint64_t m_servedTicket;
+		bool m_isStopping;
+	};
+
+	class SlotLease
+	{
+	public:
+		SlotLease(JobSlots& slots, std::atomic<bool>& hasSlot) :
+			m_slots(slots),
+			m_hasSlot(hasSlot),
+			m_slot(slots.acquire(hasSlot))
+		{
+		}
+
+		~SlotLease()
+		{
+			m_slots.release(m_slot);
+			m_hasSlot = false;
+		}
+
+		JobSlot& slot() { return m_slot; }
+
+	private:
+		JobSlots& m_slots;
+		std::atomic<bool>& m_hasSlot;
+		JobSlot& m_slot;
+	};
+
+	// A client's connection. Its thread reads requests and runs them on a signer of a job slot
+	class Connection
+	{
+	public:
+		Connection(int socket, JobSlots& slots, const SignerSettings& settings) :
+			m_socket(socket),
+			m_slots(slots),
+			m_settings(settings),
+			m_isBroken(false),
+			m_isFinished(false),
+			m_hasSlot(false)
+		{
+			m_thread = std::thread(&Connection::serve, this);
+		}
+
+		// Waits for the current request
+		virtual ~Connection()
+		{
+			m_thread.join();
+			close(m_socket);
+		}
+
+		bool isFinished() const { return m_isFinished; }
+
+		// Reads and sends of the connection fail then, so a running signature to the socket stops by its callback.
+		// Only a connection with a job is shut down. Others answer the stop error themselves or end by the poll timeout
+		void shutdownSocket()
+		{
+			if (m_hasSlot)
+			{
+				shutdown(m_socket, SHUT_RDWR);
+			}
+		}
+
+	private:
+		void serve()
+		{
+			std::string request;
+			while (!m_isBroken && readRequest(request))
+			{
+				handle(request);
+			}
+			m_isFinished = true;
+		}
+
+		// Returns false if the client has closed the connection or the daemon stops
+		bool readRequest(std::string& request)
+		{
+			for (;;)
+			{
+				const auto endPos = m_received.find('\n');
+				if (endPos != std::string::npos)
+				{
+					request.assign(m_received, 0, endPos);
+					m_received.erase(0, endPos + 1);
+					if (!request.empty() && request.back() == '\r')
+					{
+						request.pop_back();
+					}
+					return true;
+				}
+				if (m_received.size() > MAX_REQUEST_SIZE)
+				{
+					answerError("A request is larger then " + std::to_string(MAX_REQUEST_SIZE) + " B");
+					return false;
+				}
+				if (g_needStop)
+				{
+					return false;
+				}
+				pollfd pollFd = { m_socket, POLLIN, 0 };
+				const int ready = poll(&pollFd, 1, POLL_TIMEOUT_MS);
+				if (ready < 0 && errno != EINTR)
+				{
+					return false;
+				}
+				if (ready <= 0)
+				{
+					continue;
+				}
+				char buffer[4096];
+				const ssize_t readSize = recv(m_socket, buffer, sizeof(buffer), 0);
+				if (readSize <= 0)
+				{
+					return false;
+				}
+				m_received.append(buffer, static_cast<size_t>(readSize));
+			}
+		}
+
+		void handle(const std::string& request)
+		{
+			try
+			{
+				std::vector<std::string> fields;
+				std::stringstream requestStream(request);
+				for (std::string field; std::getline(requestStream, field, '\t'); )
+				{
+					fields.push_back(field);
+				}
+				if (fields.empty() || fields[0] != "sign" || fields.size() < 4 || fields.size() > 5)
+				{
+					throw std::invalid_argument("Wrong request. Expected: sign<TAB>path<TAB>blocksize<TAB>algorithm[<TAB>output path]");
+				}
+				SignerSettings settings = m_settings;
+				settings.sampleSize = parseBlockSize(fields[2]);
+				// The only algorithm of the conveyer. A request names it, so clients don't depend on a default
+				if (fields[3] != "md5")
+				{
+					throw std::invalid_argument("Unknown algorithm '" + fields[3] + "'. Supported: md5");
+				}
+				const auto startTime = std::chrono::steady_clock::now();
+				SlotLease lease(m_slots, m_hasSlot);
+				std::string& answer = lease.slot().answer;
+				uint64_t digestsCount = 0;
+				if (fields.size() == 5)
+				{
+					digestsCount = signToFile(lease.slot().signer, fields[1], settings, fields[4]);
+				}
+				else
+				{
+					digestsCount = signToSocket(lease.slot().signer, fields[1], settings, answer);
+				}
+				LOG(INFO) << "Daemon: " << fields[1] << " is signed by " << settings.sampleSize << " B blocks. Digests "
+					<< digestsCount << ". Time " << std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count() << " s";
+				answer += "done\t" + std::to_string(digestsCount) + "\n";
+				sendAnswer(answer);
+			}
+			catch (const std::exception& ex)
+			{
+				if (!m_isBroken)
+				{
+					LOG(WARNING) << "Daemon: a request is failed. " << ex.what();
+					answerError(ex.what());
+				}
+			}
+		}
+
+		size_t parseBlockSize(const std::string& field)
+		{
+			try
+			{
+				size_t parsedSize = 0;
+				const auto blockSize = std::stoull(field, &parsedSize);
+				if (parsedSize == field.size() && blockSize > 0)
+				{
+					return static_cast<size_t>(blockSize);
+				}
+			}
+			catch (const std::exception&)
+			{
+			}
+			throw std::invalid_argument("Wrong block size '" + field + "'. It should be a positive number of bytes");
+		}
+
+		uint64_t signToSocket(Signer& signer, const std::string& path, const SignerSettings& settings, std::string& answer)
+		{
+			static const char HEX_DIGITS[] = "0123456789abcdef";
+			uint64_t digestsCount = 0;
+			signer.sign(path, settings, [this, &answer, &digestsCount](uint64_t index, const Digest& digest) {
+				answer += "digest\t";
+				answer += std::to_string(index);
+				answer += '\t';
+				// Digest bytes are native words of boost's md5. Words written by high digits first are the usual md5 hex
+				for (size_t shift = 0; shift < digest.size(); shift += sizeof(uint32_t))
+				{
+					uint32_t word;
+					memcpy(&word, digest.data() + shift, sizeof(word));
+					for (int bit = 28; bit >= 0; bit -= 4)
+					{
+						answer += HEX_DIGITS[(word >> bit) & 0xF];
+					}
+				}
+				answer += '\n';
+				++digestsCount;
+				if (answer.size() >= ANSWER_BUFFER_SIZE)
+				{
+					sendAnswer(answer);
+				}
+			});
+			return digestsCount;
+		}
+
+		uint64_t signToFile(Signer& signer, const std::string& path, const SignerSettings& settings, const std::string& outputPath)
+		{
+			std::unique_ptr<FILE, int(*)(FILE*)> outputFile(fopen(outputPath.c_str(), "wb"), &fclose);
+			if (!outputFile)
+			{
+				throwOnFileError("Can't open the output file " + outputPath, errno);
+			}
+			uint64_t digestsCount = 0;
+			signer.sign(path, settings, [&outputFile, &outputPath, &digestsCount](uint64_t, const Digest& digest) {
+				if (fwrite(digest.data(), 1, digest.size(), outputFile.get()) != digest.size())
+				{
+					throwOnFileError("Can't write to the output file " + outputPath, errno);
+				}
+				++digestsCount;
+			});
+			if (fclose(outputFile.release()) != 0)
+			{
+				throwOnFileError("Can't close the output file " + outputPath, errno);
+			}
+			return digestsCount;
+		}
+
+		void answerError(std::string message)
+		{
+			std::replace(message.begin(), message.end(), '\n', ' ');
+			std::string answer = "error\t" + message + "\n";
+			try
+			{
+				sendAnswer(answer);
+			}
+			catch (const std::exception&)
+			{
+			}
+		}
+
+		// Throws runtime_error if the client has gone or doesn't read the answer for SEND_TIMEOUT.
+		// The connection is broken then and the signature is stopped
+		void sendAnswer(std::string& answer)
+		{
+			const auto deadline = std::chrono::steady_clock::now() + SEND_TIMEOUT;
+			size_t sentSize = 0;
+			while (sentSize < answer.size())
+			{
+				const ssize_t size = send(m_socket, answer.data() + sentSize, answer.size() - sentSize, MSG_NOSIGNAL | MSG_DONTWAIT);
+				if (size < 0 && errno == EINTR)
+				{
+					continue;
+				}
+				if (size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+				{
+					const auto waitTime = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+					if (waitTime.count() <= 0)
+					{
+						failConnection("The client doesn't read answers for " + std::to_string(SEND_TIMEOUT.count()) + " s. It's dropped");
+					}
+					pollfd pollFd = { m_socket, POLLOUT, 0 };
+					poll(&pollFd, 1, static_cast<int>(std::min<int64_t>(waitTime.count(), POLL_TIMEOUT_MS)));
+					continue;
+				}
+				if (size <= 0)
+				{
+					failConnection("The client has closed the connection");
+				}
+				sentSize += static_cast<size_t>(size);
+			}
+			answer.clear();
+		}
+
+		void failConnection(const std::string& message)
+		{
+			m_isBroken = true;
+			LOG(WARNING) << "Daemon: " << message;
+			throw std::runtime_error(message);
+		}
+
+		const int m_socket;
+		JobSlots& m_slots;
+		const SignerSettings m_settings;
+		std::string m_received;
+		bool m_isBroken;
+		std::atomic<bool> m_isFinished;
+		std::atomic<bool> m_hasSlot; // A job slot is taken. A stop shuts down the socket then
+		std::thread m_thread;
+	};
+
+	int listenSocket(const std::string& socketPath)
+	{
+		sockaddr_un address;
+		memset(&address, 0, sizeof(address));
+		address.sun_family = AF_UNIX;
+		if (socketPath.empty() || socketPath.size() >= sizeof(address.sun_path))
+		{
+			throw std::invalid_argument("A socket path should be not empty and shorter then " +
+				std::to_string(sizeof(address.sun_path)) + " characters");
+		}
+		memcpy(address.sun_path, socketPath.c_str(), socketPath.size());
+		// A socket of a previous daemon is left on a crash. Other files aren't removed
+		struct stat socketStat;
+		if (lstat(socketPath.c_str(), &socketStat) == 0)
+		{
+			if (!S_ISSOCK(socketStat.st_mode))
+			{
+				throw std::invalid_argument(socketPath + " exists and it isn't a socket");
+			}
+			unlink(socketPath.c_str());
+		}
+		const int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (listenFd < 0)
+		{
+			throwOnFileError("Can't create a socket", errno);
+		}
+		if (bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listenFd, SOMAXCONN) != 0)
+		{
+			const int myErrno = errno;
+			close(listenFd);
+			throwOnFileError("Can't listen on " + socketPath, myErrno);
+		}
+		return listenFd;
+	}
+}
+
+int runDaemon(const DaemonSettings& settings)
+{
+	settings.signerSettings.check();
+	// Each job uses two threads: the signer's reader and the hashing thread of its connection
+	size_t jobs = settings.jobs;
+	if (jobs == 0)
+	{
+		jobs = std::max<size_t>(getCpuBudget().effectiveCpus / 2, 1);
+	}
+	// Pools and answer buffers of slots hold their memory between jobs. So memory is bounded by the count of slots
+	const uint64_t jobMemory = getJobMemory(settings.signerSettings);
+	const uint64_t memoryJobs = settings.maxMemory / jobMemory;
+	if (memoryJobs == 0)
+	{
+		throw std::invalid_argument("Daemon memory " + std::to_string(settings.maxMemory) + " B is less then a job needs: " +
+			std::to_string(jobMemory) + " B. Set a larger memory or a smaller buffer");
+	}
+	const size_t slotsCount = static_cast<size_t>(std::min<uint64_t>(jobs, memoryJobs));
+	LOG(INFO) << "Daemon: " << slotsCount << " job slots of " << jobMemory << " B. Jobs " << jobs
+		<< ", jobs by memory " << memoryJobs;
+
+	const int listenFd = listenSocket(settings.socketPath);
+	struct sigaction stopAction;
+	memset(&stopAction, 0, sizeof(stopAction));
+	stopAction.sa_handler = onStopSignal;
+	sigaction(SIGINT, &stopAction, nullptr);
+	sigaction(SIGTERM, &stopAction, nullptr);
+	LOG(INFO) << "Daemon: listening on " << settings.socketPath;
+	std::cerr << "Listening on " << settings.socketPath << std::endl;
+
+	JobSlots slots(slotsCount);
+	std::list<std::unique_ptr<Connection>> connections;
+	while (!g_needStop)
+	{
+		connections.remove_if([](const std::unique_ptr<Connection>& connection) { return connection->isFinished(); });
+		pollfd pollFd = { listenFd, POLLIN, 0 };
+		if (poll(&pollFd, 1, POLL_TIMEOUT_MS) <= 0)
+		{
+			continue;
+		}
+		const int connectionFd = accept(listenFd, nullptr, nullptr);
+		if (connectionFd < 0)
+		{
+			LOG(WARNING) << "Daemon: can't accept a connection. Errno " << errno;
+			continue;
+		}
+		if (connections.size() >= MAX_CONNECTIONS)
+		{
+			const std::string answer = "error\tToo many connections\n";
+			send(connectionFd, answer.data(), answer.size(), MSG_NOSIGNAL);
+			close(connectionFd);
+			continue;
+		}
+		connections.push_back(std::make_unique<Connection>(connectionFd, slots, settings.signerSettings));
+	}
+	LOG(INFO) << "Daemon: stopping. Connections " << connections.size();
+	close(listenFd);
+	unlink(settings.socketPath.c_str());
+	// Requests which wait for a slot get the stop error. Clients which wait for answers or send new requests don't hold the stop
+	slots.stop();
+	for (auto& connection : connections)
+	{
+		connection->shutdownSocket();
+	}
+	connections.clear();
+	LOG(INFO) << "Daemon: stopped";
+	return 0;
+}
+#else
+int runDaemon(const DaemonSettings&)
+{
+	throw std::runtime_error("The daemon mode needs Unix domain sockets. It isn't supported on Windows");
+}
+#endif
+}
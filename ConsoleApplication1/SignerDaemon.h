@@ -0,0 +1,33 @@
+#pragma once
+#include <string>
+#include <cstdint>
+#include "Signer.h"
+
+namespace transformation_stream
+{
+// A signer service on a local Unix socket. Processes don't start per signature:
+// signers of job slots keep their threads and pools between requests.
+//
+// A client sends requests by lines. Fields are separated by tabs, so paths could have spaces:
+//   sign<TAB>path<TAB>blocksize<TAB>algorithm[<TAB>output path]
+// The answer for a request without an output path is its digests, one line per sample block:
+//   digest<TAB>index<TAB>hex
+// With the output path digests are written to the file in the format of FileSignature's signature.
+// The answer ends by one of the lines:
+//   done<TAB>digests count
+//   error<TAB>message
+// Requests of one connection run one by one. Connections wait for a free job slot in order of their requests.
+// A client which doesn't read its answer for a few seconds is dropped, so it doesn't keep a job slot.
+struct DaemonSettings
+{
+	std::string socketPath;
+	size_t jobs = { 0 }; // Signatures at the same time. 0 - by the CPU budget
+	uint64_t maxMemory = { 256 * 1024 * 1024 }; // Bytes of pools and answer buffers of all job slots
+	SignerSettings signerSettings; // IO block, buffer and hash tile of all jobs. The sample size comes with requests
+};
+
+// Serves requests till SIGINT or SIGTERM. Connections are shut down then: jobs which answer to the socket are stopped,
+// jobs to output files are finished before the exit. Requests which wait for a job slot get error<TAB>daemon is stopping.
+// Returns the exit code. Throws invalid_argument on wrong settings and runtime_error on socket errors
+int runDaemon(const DaemonSettings& settings);
+}
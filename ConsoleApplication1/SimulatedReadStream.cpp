@@ -0,0 +1,228 @@
+#include "SimulatedReadStream.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cerrno>
+#include <sstream>
+#include <stdexcept>
+#include "easylogging++.h"
+#include "HotLog.h"
+#include "PipelineTrace.h"
+#include "UsdtProbes.h"
+
+namespace transformation_stream
+{
+namespace
+{
+	// Typical values of the storage classes. Cloud volumes have a long tail of latencies
+	const StorageProfile STORAGE_PROFILES[] = {
+		{ "hdd", 6000, 0.5, 160, 1 },
+		{ "nvme", 80, 0.3, 3000, 32 },
+		{ "cloud", 1500, 0.8, 250, 16 },
+	};
+
+	// Latencies of a run are the same for the same profile
+	const uint64_t LATENCY_SEED = 42;
+
+	// splitmix64. A word of data is a hash of its index
+	uint64_t dataWord(uint64_t wordIndex)
+	{
+		uint64_t value = wordIndex + 0x9E3779B97F4A7C15ULL;
+		value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+		return value ^ (value >> 31);
+	}
+}
+
+StorageProfile getStorageProfile(const std::string& name)
+{
+	std::string names;
+	for (const auto& profile : STORAGE_PROFILES)
+	{
+		if (profile.name == name)
+		{
+			return profile;
+		}
+		names += (names.empty() ? "" : ", ") + profile.name;
+	}
+	throw std::invalid_argument("Unknown storage profile '" + name + "'. Expected: " + names);
+}
+
+void SimulatedReadStream::fillData(uint64_t position, char_type* data, size_t size)
+{
+	for (size_t filled = 0; filled < size; )
+	{
+		const uint64_t word = dataWord((position + filled) / sizeof(uint64_t));
+		const size_t shift = static_cast<size_t>((position + filled) % sizeof(uint64_t));
+		const size_t portion = std::min(sizeof(uint64_t) - shift, size - filled);
+		memcpy(data + filled, reinterpret_cast<const char*>(&word) + shift, portion);
+		filled += portion;
+	}
+}
+
+SimulatedReadStream::SimulatedReadStream(const StorageProfile& profile, uint64_t size, IStreamQueue& queue,
+	IMemBlocksPool& memPool, size_t blockSize, const ThreadPlacement& placement) :
+	m_profile(profile),
+	m_size(size),
+	m_blockSize(blockSize),
+	m_blocksCount(blockSize ? (size + blockSize - 1) / blockSize : 0),
+	m_placement(placement),
+	m_queue(queue),
+	m_memPool(memPool),
+	m_nextBlock(0),
+	m_deviceFreeAt(std::chrono::steady_clock::now()),
+	m_latencyGenerator(LATENCY_SEED),
+	m_latencyDistribution(std::log(std::max(profile.medianLatencyUs, 0.0) * 1000 + 1), profile.latencySigma),
+	m_pushedBlocks(0),
+	m_isEOF(false),
+	m_needStop(false),
+	m_isStopped(false)
+{
+	if (blockSize == 0 || profile.bandwidthMBps <= 0 || profile.maxConcurrency == 0)
+	{
+		throw std::invalid_argument("Simulated storage needs a positive block size, bandwidth and concurrency");
+	}
+	LOG(INFO) << "Creating SimulatedReadStream of " << m_size << " B on '" << m_profile.name << "' storage: latency "
+		<< m_profile.medianLatencyUs << " us, " << m_profile.bandwidthMBps << " MB/s, " << m_profile.maxConcurrency << " requests in flight";
+	if (m_blocksCount == 0)
+	{
+		finishRead();
+		return;
+	}
+	const size_t threadsCount = static_cast<size_t>(std::min<uint64_t>(m_profile.maxConcurrency, m_blocksCount));
+	for (size_t i = 0; i < threadsCount; ++i)
+	{
+		m_threads.emplace_back(&SimulatedReadStream::backgroundReading, this, i);
+	}
+}
+
+SimulatedReadStream::~SimulatedReadStream()
+{
+	stop();
+}
+
+bool SimulatedReadStream::isEOF()
+{
+	return m_isEOF;
+}
+
+void SimulatedReadStream::stop()
+{
+	if (m_isStopped.exchange(true))
+		return;
+
+	finishRead();
+	stopThreads();
+	for (auto& thread : m_threads)
+	{
+		thread.join();
+	}
+}
+
+void SimulatedReadStream::stopThreads()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_orderMutex);
+		m_needStop = true;
+	}
+	m_orderCV.notify_all();
+}
+
+void SimulatedReadStream::finishRead()
+{
+	m_isEOF = true;
+	m_queue.stopIncomes();
+}
+
+uint64_t SimulatedReadStream::simulateRequest(size_t size)
+{
+	const auto start = std::chrono::steady_clock::now();
+	std::chrono::steady_clock::time_point completion;
+	{
+		std::lock_guard<std::mutex> lock(m_deviceMutex);
+		const auto latency = std::chrono::nanoseconds(static_cast<int64_t>(m_latencyDistribution(m_latencyGenerator)));
+		const auto transfer = std::chrono::nanoseconds(static_cast<int64_t>(size * 1e9 / (m_profile.bandwidthMBps * 1024 * 1024)));
+		completion = std::max(start + latency, m_deviceFreeAt) + transfer;
+		m_deviceFreeAt = completion;
+	}
+	std::this_thread::sleep_until(completion);
+	return nanosecondsSince(start);
+}
+
+void SimulatedReadStream::backgroundReading(size_t threadIndex)
+{
+	const std::string threadName = "SimulatedReadStream-" + std::to_string(threadIndex);
+	m_placement.bindCurrentThread(threadName);
+	if (PipelineTrace::isEnabled())
+	{
+		PipelineTrace::setThreadName("SimulatedReadStream");
+	}
+	ThreadHardwareCounters threadCounters(m_hardwareCounters, "SimulatedReadStream");
+	uint64_t totalRead = 0;
+	try
+	{
+		while (!m_needStop)
+		{
+			uint64_t blockIndex = 0;
+			{
+				std::lock_guard<std::mutex> lock(m_requestMutex);
+				if (m_nextBlock == m_blocksCount)
+				{
+					break;
+				}
+				blockIndex = m_nextBlock++;
+			}
+			const uint64_t position = blockIndex * m_blockSize;
+			const size_t size = static_cast<size_t>(std::min<uint64_t>(m_blockSize, m_size - position));
+			BlockPTR block = m_memPool.get(size);
+
+			const auto readStart = std::chrono::steady_clock::now();
+			simulateRequest(size);
+			fillData(position, &(*block)[0], size);
+			const uint64_t readNs = nanosecondsSince(readStart);
+			FS_PROBE2(block_read, size, readNs);
+			if (PipelineTrace::isEnabled())
+			{
+				PipelineTrace::addSpan("read", "ReadStream", readStart, readNs, size);
+			}
+			m_counters.addBlock(size, readNs);
+			totalRead += size;
+
+			// The turn of the block. Other threads wait, so the push is in order
+			{
+				std::unique_lock<std::mutex> lock(m_orderMutex);
+				m_orderCV.wait(lock, [this, blockIndex]() { return m_pushedBlocks == blockIndex || m_needStop; });
+				if (m_needStop)
+				{
+					break;
+				}
+			}
+			m_queue.push(std::move(block));
+			HOT_LOG(DEBUG) << "The simulated block " << blockIndex << " of " << size << " (B) has moved to queue";
+			bool isLast = false;
+			{
+				std::lock_guard<std::mutex> lock(m_orderMutex);
+				isLast = (++m_pushedBlocks == m_blocksCount);
+			}
+			m_orderCV.notify_all();
+			if (isLast)
+			{
+				LOG(INFO) << "The simulated file has been read till the end successfully";
+				finishRead();
+			}
+		}
+	}
+	catch (const std::exception& ex)
+	{
+		std::stringstream ss;
+		ss << "Exception on simulated read: " << ex.what();
+		LOG(ERROR) << ss.str();
+		m_queue.pushError(EINTR, ss.str());
+		m_isEOF = true;
+		// Other threads would wait for the turn of this block forever
+		stopThreads();
+	}
+	threadCounters.setBytes(totalRead);
+}
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <memory>
+#include "IReadStream.h"
+#include "IQueue.h"
+#include "IMemBlocksPool.h"
+#include "CpuTopology.h"
+#include "PipelineStats.h"
+#include "HardwareCounters.h"
+
+namespace transformation_stream
+{
+// A class of storage for SimulatedReadStream.
+// A request waits for its latency, then transfers its bytes by the shared bandwidth of the device.
+// Latencies of requests overlap up to maxConcurrency requests, transfers don't overlap.
+struct StorageProfile
+{
+	std::string name;
+	double medianLatencyUs; // Median latency of a request
+	double latencySigma; // Sigma of the log-normal latency distribution. Larger values give a longer tail
+	double bandwidthMBps; // MB per second of the device
+	size_t maxConcurrency; // Requests in flight
+};
+
+// Returns a profile by name: hdd, nvme or cloud. Throws invalid_argument on an unknown name
+StorageProfile getStorageProfile(const std::string& name);
+
+// An input stream of deterministic synthetic data with timings of a simulated storage.
+// It feeds the conveyer like ReadStream does, so queues and the buffer size could be tried against
+// slow or fast storage without the storage. Data of a position depends on the position only.
+// maxConcurrency threads read blocks in parallel and push them to the queue in order of the stream.
+// Each thread holds a block while it waits, so the pool could grow by maxConcurrency blocks.
+class SimulatedReadStream : public IReadStream
+{
+public:
+	// size - bytes of the simulated file
+	// blockSize - bytes per request, like IO block of ReadStream
+	SimulatedReadStream(const StorageProfile& profile, uint64_t size, IStreamQueue& queue, IMemBlocksPool& memPool,
+		size_t blockSize, const ThreadPlacement& placement = ThreadPlacement());
+
+	virtual ~SimulatedReadStream();
+
+	bool isEOF() override;
+
+	void stop() override;
+
+	const StageCounters& getCounters() const override
+	{
+		return m_counters;
+	}
+
+	const HardwareCounters& getHardwareCounters() const override
+	{
+		return m_hardwareCounters;
+	}
+
+	// Writes the data of the position to the block. It's public to check signatures of the simulated data
+	static void fillData(uint64_t position, char_type* data, size_t size);
+
+private:
+	void backgroundReading(size_t threadIndex);
+
+	// Waits for the request like the device would. Returns the wait in nanoseconds
+	uint64_t simulateRequest(size_t size);
+
+	void finishRead();
+
+	// Wakes up and stops read threads. It doesn't join them
+	void stopThreads();
+
+	const StorageProfile m_profile;
+	const uint64_t m_size;
+	const size_t m_blockSize;
+	const uint64_t m_blocksCount;
+	const ThreadPlacement m_placement;
+	IStreamQueue& m_queue;
+	IMemBlocksPool& m_memPool;
+
+	// Requests are taken in order of the stream
+	std::mutex m_requestMutex;
+	uint64_t m_nextBlock;
+
+	// The device is shared by requests. It's busy by transfers till m_deviceFreeAt
+	std::mutex m_deviceMutex;
+	std::chrono::steady_clock::time_point m_deviceFreeAt;
+	std::mt19937_64 m_latencyGenerator;
+	std::lognormal_distribution<double> m_latencyDistribution;
+
+	// Completed blocks are pushed in order of the stream
+	std::mutex m_orderMutex;
+	std::condition_variable m_orderCV;
+	uint64_t m_pushedBlocks;
+
+	std::atomic<bool> m_isEOF;
+	std::atomic<bool> m_needStop;
+	std::atomic<bool> m_isStopped;
+	std::vector<std::thread> m_threads;
+	StageCounters m_counters;
+	HardwareCounters m_hardwareCounters;
+};
+}
@@ -0,0 +1,350 @@
+#include "Sweep.h"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include "easylogging++.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+#ifndef _WIN32
+extern char** environ;
+#endif
+
+namespace transformation_stream
+{
+namespace
+{
+	struct SweepBackend
+	{
+		const char* name;
+		std::vector<std::string> arguments; // Extra arguments of the child process
+		bool isFused; // Fused reads can't be larger than the IO block
+		bool isSimulated; // Synthetic data of the file size. The file isn't read
+	};
+
+	// Reads by the reader thread only, with hashing in the reader while reads are fast,
+	// or from simulated storages (see SimulatedReadStream.h)
+	const SweepBackend SWEEP_BACKENDS[] = {
+		{ "stdio", {}, false, false },
+		{ "fused", { "--fuse" }, true, false },
+		{ "sim-hdd", { "--simulate", "hdd" }, false, true },
+		{ "sim-nvme", { "--simulate", "nvme" }, false, true },
+		{ "sim-cloud", { "--simulate", "cloud" }, false, true },
+	};
+
+	const size_t GENERATE_CHUNK_SIZE = 1024 * 1024;
+	const size_t MAX_FUSED_BLOCK_SIZE = 256 * 1024;
+
+	struct ChildUsage
+	{
+		int exitCode = -1;
+		double wallSeconds = 0;
+		double userSeconds = 0;
+		double systemSeconds = 0;
+		uint64_t peakRssKB = 0;
+	};
+
+	const SweepBackend& findBackend(const std::string& name)
+	{
+		for (const auto& backend : SWEEP_BACKENDS)
+		{
+			if (name == backend.name)
+				return backend;
+		}
+		std::string names;
+		for (const auto& backend : SWEEP_BACKENDS)
+		{
+			names += (names.empty() ? "" : ", ") + std::string(backend.name);
+		}
+		throw std::invalid_argument("Unknown backend '" + name + "'. Expected: " + names);
+	}
+
+	uint64_t getFileSize(const std::string& file)
+	{
+		std::ifstream in(file, std::ios::binary | std::ios::ate);
+		return in ? static_cast<uint64_t>(in.tellg()) : 0;
+	}
+
+	// Creates a file of random data. An existing file of the same size is reused
+	std::string prepareTestFile(const std::string& directory, uint64_t size)
+	{
+		const std::string file = directory + "/sweep_" + std::to_string(size) + ".bin";
+		if (getFileSize(file) == size)
+		{
+			return file;
+		}
+		LOG(INFO) << "Generating test file " << file;
+		std::ofstream out(file, std::ios::binary | std::ios::trunc);
+		std::mt19937_64 generator(size);
+		std::vector<uint64_t> chunk(GENERATE_CHUNK_SIZE / sizeof(uint64_t));
+		for (uint64_t written = 0; written < size && out; )
+		{
+			for (auto& value : chunk)
+			{
+				value = generator();
+			}
+			const size_t portion = static_cast<size_t>(std::min<uint64_t>(GENERATE_CHUNK_SIZE, size - written));
+			out.write(reinterpret_cast<const char*>(chunk.data()), portion);
+			written += portion;
+		}
+		out.close();
+		if (!out)
+		{
+			throw std::runtime_error("Can't generate test file " + file);
+		}
+		return file;
+	}
+
+	// Writes dirty pages of the file and drops them from the page cache, so the next read goes to the storage
+	void dropFromPageCache(const std::string& file)
+	{
+#ifdef _WIN32
+		(void)file;
+#else
+		const int fd = open(file.c_str(), O_RDONLY);
+		if (fd < 0)
+		{
+			LOG(WARNING) << "Can't open " << file << " to drop it from page cache. Errno " << errno;
+			return;
+		}
+		fdatasync(fd);
+		const int err = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+		if (err)
+		{
+			LOG(WARNING) << "Can't drop " << file << " from page cache. Errno " << err;
+		}
+		close(fd);
+#endif
+	}
+
+	ChildUsage runChild(const std::string& executable, const std::vector<std::string>& arguments)
+	{
+		ChildUsage usage;
+		const auto start = std::chrono::steady_clock::now();
+#ifdef _WIN32
+		std::string commandLine = "\"" + executable + "\"";
+		for (const auto& argument : arguments)
+		{
+			commandLine += " \"" + argument + "\"";
+		}
+		STARTUPINFOA startupInfo = { sizeof(startupInfo) };
+		PROCESS_INFORMATION processInfo = {};
+		if (!CreateProcessA(NULL, &commandLine[0], NULL, NULL, FALSE, 0, NULL, NULL, &startupInfo, &processInfo))
+		{
+			throw std::runtime_error("Can't run " + executable + ". Error " + std::to_string(GetLastError()));
+		}
+		WaitForSingleObject(processInfo.hProcess, INFINITE);
+		usage.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		DWORD exitCode = 0;
+		GetExitCodeProcess(processInfo.hProcess, &exitCode);
+		usage.exitCode = static_cast<int>(exitCode);
+		FILETIME creationTime, exitTime, kernelTime, userTime;
+		if (GetProcessTimes(processInfo.hProcess, &creationTime, &exitTime, &kernelTime, &userTime))
+		{
+			// FILETIME is in 100 ns units
+			auto toSeconds = [](const FILETIME& time) {
+				return ((static_cast<uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime) / 1e7;
+			};
+			usage.userSeconds = toSeconds(userTime);
+			usage.systemSeconds = toSeconds(kernelTime);
+		}
+		PROCESS_MEMORY_COUNTERS memoryCounters = {};
+		if (GetProcessMemoryInfo(processInfo.hProcess, &memoryCounters, sizeof(memoryCounters)))
+		{
+			usage.peakRssKB = memoryCounters.PeakWorkingSetSize / 1024;
+		}
+		CloseHandle(processInfo.hThread);
+		CloseHandle(processInfo.hProcess);
+#else
+		std::vector<char*> argv;
+		argv.push_back(const_cast<char*>(executable.c_str()));
+		for (const auto& argument : arguments)
+		{
+			argv.push_back(const_cast<char*>(argument.c_str()));
+		}
+		argv.push_back(nullptr);
+		pid_t pid = 0;
+		const int err = posix_spawn(&pid, executable.c_str(), nullptr, nullptr, argv.data(), environ);
+		if (err)
+		{
+			throw std::runtime_error("Can't run " + executable + ". Errno " + std::to_string(err));
+		}
+		int status = 0;
+		rusage childUsage = {};
+		// The usage of the child only is taken, not of all children of the sweep
+		while (wait4(pid, &status, 0, &childUsage) < 0)
+		{
+			if (errno != EINTR)
+			{
+				throw std::runtime_error("Can't wait for " + executable + ". Errno " + std::to_string(errno));
+			}
+		}
+		usage.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		usage.exitCode = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+		usage.userSeconds = childUsage.ru_utime.tv_sec + childUsage.ru_utime.tv_usec / 1e6;
+		usage.systemSeconds = childUsage.ru_stime.tv_sec + childUsage.ru_stime.tv_usec / 1e6;
+		usage.peakRssKB = childUsage.ru_maxrss; // KB on Linux
+#endif
+		return usage;
+	}
+}
+
+std::string getExecutablePath(const std::string& argv0)
+{
+#ifdef _WIN32
+	char path[MAX_PATH];
+	const DWORD length = GetModuleFileNameA(NULL, path, MAX_PATH);
+	if (length > 0 && length < MAX_PATH)
+	{
+		return std::string(path, length);
+	}
+#else
+	char path[4096];
+	const ssize_t length = readlink("/proc/self/exe", path, sizeof(path));
+	if (length > 0 && static_cast<size_t>(length) < sizeof(path))
+	{
+		return std::string(path, length);
+	}
+#endif
+	return argv0;
+}
+
+std::vector<uint64_t> parseSizeList(const std::string& list)
+{
+	std::vector<uint64_t> sizes;
+	std::stringstream listStream(list);
+	std::string item;
+	while (std::getline(listStream, item, ','))
+	{
+		item.erase(std::remove_if(item.begin(), item.end(), ::isspace), item.end());
+		if (item.empty())
+			continue;
+		uint64_t multiplier = 1;
+		switch (::toupper(item.back()))
+		{
+		case 'K': multiplier = 1024; break;
+		case 'M': multiplier = 1024 * 1024; break;
+		case 'G': multiplier = 1024 * 1024 * 1024; break;
+		}
+		if (multiplier != 1)
+		{
+			item.pop_back();
+		}
+		size_t parsedLength = 0;
+		uint64_t value = 0;
+		try
+		{
+			value = std::stoull(item, &parsedLength);
+		}
+		catch (const std::exception&)
+		{
+			parsedLength = 0;
+		}
+		if (parsedLength == 0 || parsedLength != item.size() || value == 0)
+		{
+			throw std::invalid_argument("Wrong size list '" + list + "'. Expected format is like 64K,1M,2G");
+		}
+		sizes.push_back(value * multiplier);
+	}
+	return sizes;
+}
+
+int runSweep(const SweepSettings& settings, const std::string& executable, std::ostream& out)
+{
+	if (settings.csvFile.empty() || settings.fileSizes.empty() || settings.sampleSizes.empty() ||
+		settings.ioBlockSizes.empty() || settings.bufferSizes.empty() || settings.backends.empty() || settings.repeats == 0)
+	{
+		throw std::invalid_argument("Sweep needs a CSV file, at least one value of each list and a positive repeats count");
+	}
+	for (const auto& backend : settings.backends)
+	{
+		findBackend(backend);
+	}
+#ifdef _WIN32
+	if (settings.isCold)
+	{
+		LOG(WARNING) << "Dropping files from the page cache isn't supported on Windows. Runs are warm";
+	}
+#endif
+	std::ofstream csv(settings.csvFile, std::ios::trunc);
+	if (!csv)
+	{
+		throw std::runtime_error("Can't open file " + settings.csvFile + " for sweep results");
+	}
+	csv << "file_size,backend,blocksize,ioblock,iobuffer,cold,run,exit_code,wall_s,mb_per_s,user_cpu_s,sys_cpu_s,peak_rss_kb\n";
+	const std::string signatureFile = settings.directory + "/sweep_signature.out";
+	size_t runsCount = 0, skippedCount = 0, failedCount = 0;
+	for (const auto fileSize : settings.fileSizes)
+	{
+		const std::string sourceFile = prepareTestFile(settings.directory, fileSize);
+		for (const auto& backendName : settings.backends)
+		{
+			const auto& backend = findBackend(backendName);
+			for (const auto sampleSize : settings.sampleSizes)
+			for (const auto ioBlockSize : settings.ioBlockSizes)
+			for (const auto bufferSize : settings.bufferSizes)
+			{
+				// The same rule as SignatureSettings::check()
+				if (bufferSize < 2 * ioBlockSize)
+				{
+					++skippedCount;
+					continue;
+				}
+				std::vector<std::string> arguments = { "-i", sourceFile, "-o", signatureFile,
+					"--blocksize", std::to_string(sampleSize), "--ioblock", std::to_string(ioBlockSize),
+					"--iobuffer", std::to_string(bufferSize) };
+				arguments.insert(arguments.end(), backend.arguments.begin(), backend.arguments.end());
+				if (backend.isFused)
+				{
+					arguments.push_back("--fuse-block");
+					arguments.push_back(std::to_string(std::min(MAX_FUSED_BLOCK_SIZE, ioBlockSize)));
+				}
+				if (backend.isSimulated)
+				{
+					arguments.push_back("--sim-size");
+					arguments.push_back(std::to_string(fileSize));
+				}
+				for (size_t run = 0; run < settings.repeats; ++run)
+				{
+					if (settings.isCold)
+					{
+						dropFromPageCache(sourceFile);
+					}
+					const auto usage = runChild(executable, arguments);
+					const double megabytesPerSecond = usage.wallSeconds > 0 ? fileSize / (1024.0 * 1024.0) / usage.wallSeconds : 0;
+					csv << fileSize << ',' << backend.name << ',' << sampleSize << ',' << ioBlockSize << ',' << bufferSize
+						<< ',' << (settings.isCold ? 1 : 0) << ',' << run << ',' << usage.exitCode << ',' << usage.wallSeconds
+						<< ',' << megabytesPerSecond << ',' << usage.userSeconds << ',' << usage.systemSeconds
+						<< ',' << usage.peakRssKB << '\n';
+					csv.flush();
+					out << backend.name << " size=" << fileSize << " blocksize=" << sampleSize << " ioblock=" << ioBlockSize
+						<< " iobuffer=" << bufferSize << " run=" << run << ": " << megabytesPerSecond << " MB/s"
+						<< (usage.exitCode ? " FAILED" : "") << std::endl;
+					++runsCount;
+					failedCount += usage.exitCode ? 1 : 0;
+				}
+			}
+		}
+	}
+	std::remove(signatureFile.c_str());
+	out << runsCount << " runs (" << failedCount << " failed), " << skippedCount
+		<< " combinations skipped by iobuffer < 2 * ioblock. Results are in " << settings.csvFile << std::endl;
+	return failedCount ? -1 : 0;
+}
+}
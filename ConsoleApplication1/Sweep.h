@@ -0,0 +1,32 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <ostream>
+#include <cstdint>
+
+namespace transformation_stream
+{
+struct SweepSettings
+{
+	std::string csvFile; // Results, one row per run
+	std::string directory = { "." }; // Test files and signatures are created here
+	std::vector<uint64_t> fileSizes; // Test files of these sizes are generated once and reused
+	std::vector<size_t> sampleSizes; // --blocksize values
+	std::vector<size_t> ioBlockSizes; // --ioblock values
+	std::vector<size_t> bufferSizes; // --iobuffer values
+	std::vector<std::string> backends; // Ways to read the source. See SWEEP_BACKENDS in Sweep.cpp
+	bool isCold = { true }; // Drop the source from the page cache before each run
+	size_t repeats = { 1 };
+};
+
+// The path of the running executable. argv0 is a fallback
+std::string getExecutablePath(const std::string& argv0);
+
+// Parses a list of sizes like "64K,1M,2G". Throws invalid_argument on a wrong format
+std::vector<uint64_t> parseSizeList(const std::string& list);
+
+// Runs the executable for each combination of settings on each file and writes wall time, MB/s, CPU time
+// and peak RSS of the child process to the CSV. Combinations which check() rejects are skipped.
+// Returns the exit code. Throws invalid_argument on wrong settings and runtime_error on IO errors
+int runSweep(const SweepSettings& settings, const std::string& executable, std::ostream& out);
+}
@@ -2,6 +2,8 @@
 #include "IReadStream.h"
 #include "IWriteStream.h"
 #include "ITransformationStrategy.h"
+#include "IQueue.h"
+#include "HardwareCounters.h"
 
 #include <boost/uuid/name_generator_md5.hpp>
 #include <iostream>
@@ -10,36 +12,51 @@ namespace transformation_stream
 
 struct TransformationEngine
 {
-	TransformationEngine(IStreamQueue& in, IStreamQueue& out, ITransformationStrategy& strategy) :
+	// batchMaxBytes - blocks of up to this size in total are taken from the input queue by one synchronization.
+	// 0 means one block at a time
+	TransformationEngine(IStreamQueue& in, IStreamQueue& out, ITransformationStrategy& strategy, size_t batchMaxBytes = 0) :
 		m_in(in),
 		m_out(out),
-		m_transformationStrategy(strategy)
+		m_transformationStrategy(strategy),
+		m_batchMaxBytes(batchMaxBytes)
 	{
+		m_batch.reserve(MAX_BATCH_BLOCKS);
 	}
 
 	void transform()
 	{
 		//TIMED_FUNC(TEtimerObj1);
 		size_t totalSize = 0, readSize = 0;
+		ThreadHardwareCounters threadCounters(m_hardwareCounters, "TransformationEngine");
 		try
 		{
 			while (!m_in.isInputStopped())
 			{
 				//TIMED_SCOPE(TEtimerBlkObj2, "TransformLoop");
-				auto bufferPtr = m_in.pop();
-				if (bufferPtr)
+				m_batch.clear();
+				if (m_in.popBatch(m_batch, MAX_BATCH_BLOCKS, m_batchMaxBytes))
 				{
-					readSize = bufferPtr->size();
-					m_transformationStrategy.transform(std::move(bufferPtr));
-					totalSize += readSize;
+					for (auto& bufferPtr : m_batch)
+					{
+						readSize = bufferPtr->size();
+						m_transformationStrategy.transform(std::move(bufferPtr));
+						totalSize += readSize;
+					}
+					m_transformationStrategy.flush();
 				}
 				else
 				{
 					LOG(INFO) <<  "No buffer come" ;
 				}
 			}
+			// An error stops the input like the end of data. popBatch() throws it then, so the rest of a cancelled
+			// or failed input isn't dumped as a last digest
+			m_batch.clear();
+			m_in.popBatch(m_batch, MAX_BATCH_BLOCKS, m_batchMaxBytes);
 			m_transformationStrategy.dump();
+			m_transformationStrategy.flush();
 			m_out.stopIncomes();
+			threadCounters.setBytes(totalSize);
 			LOG(INFO) << "The file is read till the end. Size " << totalSize;
 		}
 		catch (const std::exception& ex)
@@ -47,13 +64,23 @@ struct TransformationEngine
 			LOG(ERROR) << "Stop transformation by exception on byte " << totalSize << ". Error: " << ex.what();
 			m_in.stopIncomes();
 			m_out.pushError(EINTR, ex.what());
-			throw ex;
+			throw;
 		}
 	}
 
+	const HardwareCounters& getHardwareCounters() const
+	{
+		return m_hardwareCounters;
+	}
+
 	IStreamQueue& m_in;
 	IStreamQueue& m_out;
 	ITransformationStrategy& m_transformationStrategy;
 
+	static constexpr size_t MAX_BATCH_BLOCKS = 64;
+	const size_t m_batchMaxBytes;
+	std::vector<BlockPTR> m_batch;
+	HardwareCounters m_hardwareCounters;
+
 };
 }//end of namespace  transformation_stream
\ No newline at end of file
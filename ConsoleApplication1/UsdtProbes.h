@@ -0,0 +1,31 @@
+#pragma once
+
+// Static tracepoints (USDT) of the conveyer for bpftrace, perf and SystemTap, e.g.
+//   bpftrace -e 'usdt:./FileSignature:filesignature:hash_done { @ns = hist(arg1); }'
+// A probe is a single nop while nothing is attached, so probes are in release builds too.
+// They are compiled if <sys/sdt.h> (systemtap-sdt-dev) is found. Define FS_DISABLE_USDT to drop them.
+//
+// Probes and arguments:
+//   block_read(bytes, ns)                   - a block is read from the source file
+//   queue_push(queue name, bytes, depth)    - blocks are pushed to a queue, depth is in bytes after the push
+//   queue_pop(queue name, bytes, depth)     - blocks are popped from a queue
+//   hash_done(bytes, ns)                    - a block is hashed
+//   digest_ready(index)                     - a digest of a portion is calculated
+//   digest_written(bytes, ns)               - a batch of digests is written to the result file
+//   flush(bytes, ns)                        - the result file is flushed (Windows. POSIX writes by writev)
+#if defined(__has_include) && !defined(FS_DISABLE_USDT)
+#	if __has_include(<sys/sdt.h>)
+#		include <sys/sdt.h>
+#		define FS_USDT_ENABLED 1
+#	endif
+#endif
+
+#ifdef FS_USDT_ENABLED
+#	define FS_PROBE1(name, arg1) DTRACE_PROBE1(filesignature, name, arg1)
+#	define FS_PROBE2(name, arg1, arg2) DTRACE_PROBE2(filesignature, name, arg1, arg2)
+#	define FS_PROBE3(name, arg1, arg2, arg3) DTRACE_PROBE3(filesignature, name, arg1, arg2, arg3)
+#else
+#	define FS_PROBE1(name, arg1) ((void)0)
+#	define FS_PROBE2(name, arg1, arg2) ((void)0)
+#	define FS_PROBE3(name, arg1, arg2, arg3) ((void)0)
+#endif
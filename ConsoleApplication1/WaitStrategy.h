@@ -0,0 +1,51 @@
+#pragma once
+#include <string>
+#include <stdexcept>
+#include <thread>
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TRANSFORMATION_STREAM_HAS_PAUSE 1
+#endif
+
+namespace transformation_stream
+{
+// A way of waiting for a free space or for data in a queue.
+// Spinning saves a futex wake and a context switch per handoff, but burns a CPU while waiting.
+enum class WaitStrategy
+{
+	Block = 0, // Park on a condition variable at once
+	SpinThenPark = 1, // Spin a bit, yield a bit, then park on a condition variable
+	Spin = 2 // Busy spin. It's only for dedicated (pinned) cores
+};
+
+inline WaitStrategy parseWaitStrategy(const std::string& name)
+{
+	if (name == "block")
+		return WaitStrategy::Block;
+	if (name == "spin-then-park")
+		return WaitStrategy::SpinThenPark;
+	if (name == "spin")
+		return WaitStrategy::Spin;
+	throw std::invalid_argument("Unknown wait strategy '" + name + "'. Allowed: block, spin-then-park, spin");
+}
+
+inline const char* toString(WaitStrategy strategy)
+{
+	switch (strategy)
+	{
+	case WaitStrategy::SpinThenPark: return "spin-then-park";
+	case WaitStrategy::Spin: return "spin";
+	default: return "block";
+	}
+}
+
+// A hint to the CPU inside of a spin loop
+inline void cpuRelax()
+{
+#ifdef TRANSFORMATION_STREAM_HAS_PAUSE
+	_mm_pause();
+#else
+	std::this_thread::yield();
+#endif
+}
+}
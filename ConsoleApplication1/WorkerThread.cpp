@@ -0,0 +1,62 @@
+#include "WorkerThread.h"
+#include <memory>
+#include "easylogging++.h"
+
+namespace transformation_stream
+{
+WorkerThread::WorkerThread(const std::string& name, const LogCallback* logRoute) :
+	m_name(name),
+	m_logRoute(logRoute),
+	m_needStop(false),
+	m_thread(&WorkerThread::backgroundRunning, this)
+{
+}
+
+WorkerThread::~WorkerThread()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_needStop = true;
+	}
+	m_tasksCV.notify_one();
+	m_thread.join();
+}
+
+std::future<void> WorkerThread::run(std::function<void()> task)
+{
+	std::packaged_task<void()> packagedTask(std::move(task));
+	auto result = packagedTask.get_future();
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_tasks.push_back(std::move(packagedTask));
+	}
+	m_tasksCV.notify_one();
+	return result;
+}
+
+void WorkerThread::backgroundRunning()
+{
+	std::unique_ptr<ScopedLogRoute> logRoute;
+	if (m_logRoute)
+	{
+		logRoute = std::make_unique<ScopedLogRoute>(*m_logRoute);
+	}
+	std::unique_lock<std::mutex> lock(m_mutex);
+	for (;;)
+	{
+		m_tasksCV.wait(lock, [this]() { return m_needStop || !m_tasks.empty(); });
+		// Submitted tasks are finished even on stop. Their owners wait for them
+		if (m_tasks.empty())
+		{
+			lock.unlock();
+			LOG(INFO) << m_name << ": Worker thread is stopped";
+			return;
+		}
+		auto task = std::move(m_tasks.front());
+		m_tasks.pop_front();
+		lock.unlock();
+		task();
+		lock.lock();
+	}
+}
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <functional>
+#include <string>
+#include "LogRoute.h"
+
+namespace transformation_stream
+{
+// A long living thread which runs tasks one by one in order of their submission.
+// Background stages (like ReadStream) run on it instead of a thread of their own,
+// so repeated conveyer runs of one process don't pay a thread creation each time.
+class WorkerThread
+{
+public:
+	// logRoute - logs of the thread go there (see ScopedLogRoute). It should outlive the thread. Null - no route
+	explicit WorkerThread(const std::string& name, const LogCallback* logRoute = nullptr);
+
+	// Waits for submitted tasks and stops the thread
+	virtual ~WorkerThread();
+
+	// The future is ready when the task is finished. It keeps an exception of the task
+	std::future<void> run(std::function<void()> task);
+
+	// True on the thread of the worker, i.e. inside a task
+	bool isCurrentThread() const
+	{
+		return std::this_thread::get_id() == m_thread.get_id();
+	}
+
+	WorkerThread(const WorkerThread&) = delete;
+	WorkerThread& operator=(const WorkerThread&) = delete;
+
+private:
+	void backgroundRunning();
+
+	const std::string m_name; // Just for logs
+	const LogCallback* const m_logRoute;
+	std::mutex m_mutex;
+	std::condition_variable m_tasksCV;
+	std::deque<std::packaged_task<void()>> m_tasks;
+	bool m_needStop;
+	std::thread m_thread;
+};
+}
@@ -6,13 +6,27 @@
 #include <functional>
 #include <atomic>
 #include <mutex>
+#include <condition_variable>
+#include <thread>
 #include <sstream>
 #include <cstdio>
 #include <iostream>
 #include "easylogging++.h"
 #include "IWriteStream.h"
 #include "IQueue.h"
+#include "IMemBlocksPool.h"
 #include "CommonStreamBuffer.h"
+#include "CpuTopology.h"
+#include "PipelineStats.h"
+#include "PipelineTrace.h"
+#include "HardwareCounters.h"
+#include "UsdtProbes.h"
+#include <chrono>
+#ifndef _WIN32
+#include <sys/uio.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
 
 using namespace std;
 
@@ -29,8 +43,13 @@ public:
 	// file - a name of a file to write
 	// queue - a source of input stream
 	// ioBlockSize - size in bytes of block for disk io communication
-	WriteStream(const std::string& file, IStreamQueue& queue, size_t ioBlockSize) :
+	// placement - CPUs and NUMA node for the background thread
+	// blocksPool - written blocks are returned to this pool if it's set. Otherwise they are freed
+	WriteStream(const std::string& file, IStreamQueue& queue, size_t ioBlockSize,
+		const ThreadPlacement& placement = ThreadPlacement(), IMemBlocksPool* blocksPool = nullptr) :
 		m_ioBlockSize(ioBlockSize),
+		m_placement(placement),
+		m_blocksPool(blocksPool),
 		m_fileName(file),
 		m_file(nullptr), 
 		m_queue(queue),
@@ -55,6 +74,9 @@ public:
 			LOG(ERROR) << ss.str() << ". Errno " << myErrno;
 			throwOnFileError(ss.str(), myErrno);
 		}
+#ifndef _WIN32
+		m_iovecs.reserve(MAX_WRITE_BATCH_BLOCKS);
+#endif
 		// run a background thread of the file write by data from the queue
 		m_backgroundWrite = make_unique<thread>(std::bind(&WriteStream::backgroundWrittingToFile, this));
 	}
@@ -107,6 +129,16 @@ public:
 
 	}
 
+	const StageCounters& getCounters() const
+	{
+		return m_counters;
+	}
+
+	const HardwareCounters& getHardwareCounters() const
+	{
+		return m_hardwareCounters;
+	}
+
 	void cancel() override
 	{
 		m_needStop = true;
@@ -127,7 +159,19 @@ protected:
 
 	void flush(size_t& bytesToFlush)
 	{
-		if (fflush(m_file) != 0)
+#ifdef _WIN32
+		const auto flushStart = chrono::steady_clock::now();
+		const int flushResult = fflush(m_file);
+		const uint64_t flushNs = nanosecondsSince(flushStart);
+		addRelaxed(m_counters.flushNs, flushNs);
+		m_counters.flushLatency.record(flushNs);
+		FS_PROBE2(flush, bytesToFlush, flushNs);
+		if (PipelineTrace::isEnabled())
+		{
+			PipelineTrace::addSpan("flush", "WriteStream", flushStart, flushNs, bytesToFlush);
+		}
+		addRelaxed(m_counters.flushes, 1);
+		if (flushResult != 0)
 		{
 			m_errno = errno;
 			if (m_errno)
@@ -136,30 +180,109 @@ protected:
 				m_isEOF = true;
 			}
 		}
+#endif
+		// On POSIX writeBatch() writes by writev past the stdio buffer. So fflush has nothing to write and nothing to time.
+		// The time of writes to the kernel is the write latency there
 		bytesToFlush = 0;
 	}
 
+	// Write all blocks of the batch to the file. Returns false on an error, errno is set then.
+	// On POSIX it's one writev call for the whole batch. The stdio buffer of m_file isn't used there at all
+	bool writeBatch(std::vector<BlockPTR>& batch, size_t& written)
+	{
+		written = 0;
+#ifdef _WIN32
+		for (auto& block : batch)
+		{
+			const size_t writeCount = fwrite(&(*block)[0], 1/*sizeof(char_type)*/, block->size(), m_file);
+			written += writeCount;
+			if (writeCount != block->size())
+			{
+				return false;
+			}
+		}
+		return true;
+#else
+		m_iovecs.clear();
+		for (auto& block : batch)
+		{
+			m_iovecs.push_back({ &(*block)[0], block->size() });
+		}
+		size_t firstIovec = 0;
+		while (firstIovec < m_iovecs.size())
+		{
+			const ssize_t writeCount = writev(fileno(m_file), &m_iovecs[firstIovec], static_cast<int>(m_iovecs.size() - firstIovec));
+			if (writeCount < 0)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+				return false;
+			}
+			written += writeCount;
+			// Skip fully written blocks and shift the partially written one
+			for (size_t rest = writeCount; rest > 0 && firstIovec < m_iovecs.size(); )
+			{
+				auto& iov = m_iovecs[firstIovec];
+				if (rest < iov.iov_len)
+				{
+					iov.iov_base = static_cast<char*>(iov.iov_base) + rest;
+					iov.iov_len -= rest;
+					rest = 0;
+				}
+				else
+				{
+					rest -= iov.iov_len;
+					++firstIovec;
+				}
+			}
+		}
+		return true;
+#endif
+	}
+
 	//Write a content from buffer to the file
 	void backgroundWrittingToFile()
 	{
 		unique_lock<decltype(m_jobEndCVMutex)> lock(m_jobEndCVMutex);//It will unlocked on the end of job
+		m_placement.bindCurrentThread("WriteStream");
+		if (PipelineTrace::isEnabled())
+		{
+			PipelineTrace::setThreadName("WriteStream");
+		}
+		ThreadHardwareCounters threadCounters(m_hardwareCounters, "WriteStream");
 		size_t totalWritten = 0;//bytes
 		// It indicates how much bytes were written to the file without flush operation
 		size_t bytesToFlush = 0; 
+		std::vector<BlockPTR> batch;
+		batch.reserve(MAX_WRITE_BATCH_BLOCKS);
 		try 
 		{
 			while (!isNeedToStopWrite())
 			{
-				auto ptr = std::move(m_queue.pop());
-				if (!ptr) 
+				// Blocks are taken by batches of up to an IO block size
+				batch.clear();
+				if (!m_queue.popBatch(batch, MAX_WRITE_BATCH_BLOCKS, m_ioBlockSize))
 				{
 					LOG(INFO) << "It's come a null from queue." << " Errno=" << m_errno <<
 						", isEOF="<< m_isEOF << ". Continue";
 					continue;
 				}
-				const size_t bufferSize = ptr->size();
-				const size_t writeCount = fwrite(&(*ptr)[0], 1/*sizeof(char_type)*/, bufferSize, m_file);
-				if (writeCount != bufferSize)
+				size_t bufferSize = 0;
+				const auto writeStart = chrono::steady_clock::now();
+				const bool isWritten = writeBatch(batch, bufferSize);
+				const uint64_t writeNs = nanosecondsSince(writeStart);
+				addRelaxed(m_counters.busyNs, writeNs);
+				m_counters.latency.record(writeNs);
+				FS_PROBE2(digest_written, bufferSize, writeNs);
+				if (PipelineTrace::isEnabled())
+				{
+					PipelineTrace::addSpan("write", "WriteStream", writeStart, writeNs, bufferSize);
+				}
+				addRelaxed(m_counters.bytes, bufferSize);
+				addRelaxed(m_counters.blocks, batch.size());
+				if (!isWritten)
 				{
 					m_errno = errno;
 					if (m_errno == 0)
@@ -172,6 +295,13 @@ protected:
 					break;
 				}
 
+				if (m_blocksPool)
+				{
+					for (auto& block : batch)
+					{
+						m_blocksPool->push(std::move(block));
+					}
+				}
 				totalWritten += bufferSize;
 				bytesToFlush += bufferSize;
 				bool needFlush = (bytesToFlush >= m_ioBlockSize) ? true : false;
@@ -200,6 +330,7 @@ protected:
 		}
 		m_isEOF = true;
 		m_isStopped = true;
+		threadCounters.setBytes(totalWritten);
 		LOG(INFO) << "Total bytes written: " << totalWritten << ". Is EOF=" << m_isEOF 
 			<< " . Errno="<<m_errno;
 	}
@@ -208,6 +339,12 @@ protected:
 	unique_ptr<std::thread> m_backgroundWrite;
 
 	const size_t m_ioBlockSize; // Optimal size of the block to flash on disk
+	static constexpr size_t MAX_WRITE_BATCH_BLOCKS = 64;
+#ifndef _WIN32
+	std::vector<iovec> m_iovecs; // It's reused by batches
+#endif
+	const ThreadPlacement m_placement;
+	IMemBlocksPool* m_blocksPool;
 
 	//Event of end background write
 	mutex m_jobEndCVMutex;
@@ -221,5 +358,7 @@ protected:
 	atomic<bool> m_isEOF;
 	atomic<bool> m_needStop;
 	atomic<int> m_errno;
+	StageCounters m_counters;
+	HardwareCounters m_hardwareCounters;
 };
 };//end of namespace
\ No newline at end of file
@@ -49,7 +49,8 @@
 #endif
 //my project settings
 #	define ELPP_THREAD_SAFE 1
-#	define ELPP_DEFAULT_LOG_FILE "app.log"
+// No app.log for hosts of the library. FileSignature sets FILENAME in logger.config
+#	define ELPP_NO_DEFAULT_LOG_FILE
 #	define ELPP_STL_LOGGING 1
 #	define ELPP_FEATURE_PERFORMANCE_TRACKING 1
 // Clang++